@@ -1,29 +1,38 @@
 #define _SCL_SECURE_NO_WARNINGS 1
 #include "common.h"
+#include "dedupe.h"
 #include "error.h"
+#include "fileinfo.h"
+#include "fs.h"
+#include "journal.h"
+#include "jsonl.h"
+#include "manifest.h"
+#include "path.h"
+#include "stats.h"
+#include "threadpool.h"
+#include "utf8.h"
+#include "walk.h"
 
-#include <winioctl.h>
-#include <Shlwapi.h>
 #include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cwchar>
+#include <functional>
+#include <memory>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
-#include <getopt/getopt.h>
+#include <getopt/optparser.h>
+#include <getopt/responsefiles.h>
 #include <optional>
 
-struct REPARSE_POINT_HEADER {
-	ULONG ReparseTag;
-	USHORT ReparseDataLength;
-	USHORT Reserved;
-};
-
-struct REPARSE_MOUNT_POINT_BUFFER {
-	REPARSE_POINT_HEADER Header;
-	USHORT SubstituteNameOffset;
-	USHORT SubstituteNameLength;
-	USHORT PrintNameOffset;
-	USHORT PrintNameLength;
-	WCHAR  PathBuffer[0];
-};
+#ifndef _WIN32
+#include <clocale>
+#endif
 
 enum DirOption {
 	DirOptionTargetIsFile = -1,
@@ -31,17 +40,73 @@ enum DirOption {
 	DirOptionTargetIsDir = 1,
 };
 
+// Long options without a short equivalent use IDs from the private use area,
+// which nobody will type as a short option.
+enum LongOption {
+	LongOptionFromFile = 0xF000,
+	LongOptionJobs,
+	LongOptionOutput,
+	LongOptionKeepGoing,
+	LongOptionSkipIdentical,
+	LongOptionAtomic,
+	LongOptionRead,
+	LongOptionVerify,
+	LongOptionDedupe,
+	LongOptionRecursive,
+	LongOptionTransactional,
+	LongOptionRollback,
+	LongOptionDryRun,
+	LongOptionStats,
+};
+
 enum LinkType {
 	LinkTypeHard = 0,
 	LinkTypeSymbolic,
 	LinkTypeJunction,
 };
 
-__declspec(noreturn) static void WlnAbortWithUsage() {
+// LinkOptions are the options that apply to every link a run creates.
+struct LinkOptions {
+	LinkType type;
+	bool force;
+	bool relative;
+	bool verbose;
+	bool skipIdentical;
+	bool atomic;
+	bool verify; // check that the links exist as described instead of making them
+	bool dryRun; // plan the links, and print the plan instead of making them
+};
+
+// PlanHints are what a caller of WlnPlanLink already knows about a link, so
+// that it needn't be looked up.
+enum PlanHints {
+	PlanHintNone = 0,
+	PlanHintNewDestination = 1, // it goes in a directory that's yet to be created
+	PlanHintTargetIsFile = 2, // the target was just found, and isn't a directory
+};
+
+// A LinkPlan is one link, resolved and checked against what's there by
+// WlnPlanLink, for WlnExecuteLink to make.
+struct LinkPlan {
+	std::wstring target;
+	std::wstring link; // absolute
+	std::wstring name; // link, or its name in dir
+	const WlnFsDirectory* dir;
+	std::wstring contents; // what it links to: target, or a symbolic link's text, or a junction's absolute target
+	bool targetIsDirectory; // for symbolic links
+	std::optional<WlnFileInfo> destFi; // whatever is at link now
+	WlnLinkOutcome outcome; // Created if it's still to be made
+};
+
+[[noreturn]] static void WlnAbortWithUsage() {
 	fwprintf(stderr, L"Usage: %ls [option]... [-T] <target> <link>\r\n"
 		L"  or:  %ls [option]... <target>\r\n"
 		L"  or:  %ls [option]... <target...> <directory>\r\n"
 		L"  or:  %ls [option]... -t <directory> <target>\r\n"
+		L"  or:  %ls --read [option]... <link>...\r\n"
+		L"  or:  %ls --recursive [option]... <directory> <destination>\r\n"
+		L"  or:  %ls --dedupe=<directory> [option]...\r\n"
+		L"  or:  %ls --rollback=<journal>\r\n"
 		L"\r\n"
 		L"  -s, --symbolic                      create symbolic links instead of hard links\r\n"
 		L"  -j, --junction                      create Windows directory junctions instead of hard links\r\n"
@@ -49,118 +114,179 @@ __declspec(noreturn) static void WlnAbortWithUsage() {
 		L"\r\n"
 		L"  -r, --relative                      create symbolic links relative to link location\r\n"
 		L"  -f, --force                         remove existing destination files\r\n"
+		L"      --atomic                        with -f, replace existing files by renaming the\r\n"
+		L"                                      new link over them, so they never go missing\r\n"
 		L"  -t, --target-directory=<directory>  specify the <directory> in which to create links\r\n"
 		L"  -T, --no-target-directory           never treat <link> as a directory\r\n"
+		L"      --recursive                     recreate the directories under <directory> in\r\n"
+		L"                                      <destination>, and link every file in them\r\n"
+		L"      --skip-identical                leave existing links that already point to\r\n"
+		L"                                      <target> alone, even with -f\r\n"
 		L"\r\n"
 		L"  -v, --verbose                       print the name of each linked file\r\n"
+		L"      --dry-run                       check every link, and print what would be\r\n"
+		L"                                      changed instead of changing it\r\n"
+		L"\r\n"
+		L"      --read                          print where each <link> (symbolic link or junction)\r\n"
+		L"                                      points instead, like readlink; --from-file reads\r\n"
+		L"                                      the link named by each record\r\n"
+		L"      --verify                        check that the links exist as the other options\r\n"
+		L"                                      describe (type, target) instead of making them,\r\n"
+		L"                                      and list every one that doesn't\r\n"
+		L"      --dedupe=<directory>            replace files under <directory> that have the\r\n"
+		L"                                      same contents with hard links to one of them\r\n"
+		L"\r\n"
+		L"      --from-file=<manifest>          read <target> TAB <link> lines from <manifest>\r\n"
+		L"                                      (or standard input, for -) instead of the command line\r\n"
+		L"  -0, --null                          manifest records are <target> NUL <link> NUL\r\n"
+		L"      --jobs=<n>                      create up to <n> links at once (0: one per CPU)\r\n"
+		L"      --output=<format>               text (the default), or jsonl to also write one\r\n"
+		L"                                      JSON result per link to standard output\r\n"
+		L"      --keep-going                    carry on past links that can't be created, and\r\n"
+		L"                                      list them all at the end\r\n"
+		L"      --stats                         time each step of making links, and print\r\n"
+		L"                                      counts, totals and percentiles at the end\r\n"
+		L"      --transactional=<journal>       record every change in <journal>, and undo them\r\n"
+		L"                                      all if any link fails; files -f replaces are\r\n"
+		L"                                      kept until the end, so they can be put back\r\n"
+		L"      --rollback=<journal>            undo the changes recorded by a --transactional\r\n"
+		L"                                      run that was stopped before it could\r\n"
+		L"\r\n"
+		L"  @<file>                             read more arguments from <file>, split as on a\r\n"
+		L"                                      command line (UTF-8, or UTF-16 with a BOM)\r\n"
 		L"\r\n"
 		L"  -h, --help         display this help\r\n"
 		, WlnGetProgName().c_str()
 		, WlnGetProgName().c_str()
 		, WlnGetProgName().c_str()
 		, WlnGetProgName().c_str()
+		, WlnGetProgName().c_str()
+		, WlnGetProgName().c_str()
+		, WlnGetProgName().c_str()
+		, WlnGetProgName().c_str()
 	);
 	exit(0);
 }
 
-static std::wstring WlnMakePathAbsolute(const std::wstring& path) {
-	if(path.compare(0, 4, L"\\??\\") == 0) return path;
+// Paths are normalized into a per-thread arena, which WlnPlanLink resets for
+// every link it plans.
+static thread_local WlnPathArena pathArena;
 
-	wchar_t buf[LONG_MAX_PATH];
-	if(!GetFullPathNameW(path.c_str(), std::extent<decltype(buf)>::value, buf, nullptr)) {
-		WlnAbortWithWin32Error(GetLastError(), L"Failed to locate `%ls' relative to cwd.", path.c_str());
+// WlnGetCurrentDirectory returns the current directory, which we never change.
+static const std::wstring& WlnGetCurrentDirectory() {
+	static std::wstring cwd = []()->auto {
+		std::wstring cwd;
+		if(int err = WlnFsGetCurrentDirectory(cwd)) {
+			WlnAbortWithSystemError(err, L"Failed to determine the current directory.");
+		}
+		return cwd;
+	}();
+	return cwd;
+}
+
+// WlnMakePathAbsolute returns the normalized absolute form of path. It lives
+// in pathArena, so it must be copied if it's needed after the next link.
+static std::wstring_view WlnMakePathAbsolute(std::wstring_view path) {
+	WlnStatTimer timer{WlnStatPhase::ResolvePath};
+	std::wstring_view full;
+	if(WlnNormalizePath(path, WlnGetCurrentDirectory(), WlnNativePathStyle, pathArena, full) == WlnNormalizeResult::NeedsDriveDirectory) {
+		std::wstring drivecwd;
+		if(int err = WlnFsGetDriveDirectory(path[0], drivecwd)) {
+			WlnAbortWithSystemError(err, L"Failed to locate `%.*ls' relative to cwd.", static_cast<int>(path.size()), path.data());
+		}
+		WlnNormalizePath(path.substr(2), drivecwd, WlnNativePathStyle, pathArena, full);
 	}
-	return buf;
+	return full;
 }
 
 // WlnMakePathAbsoluteAsDirectory is like WlnMakePathAbsolute, but it
 // strips off the final filename and returns only the directory.
-static std::wstring WlnMakePathAbsoluteAsDirectory(const std::wstring& path) {
-	wchar_t buf[LONG_MAX_PATH];
-	wchar_t* filename = nullptr;
-	if(!GetFullPathNameW(path.c_str(), std::extent<decltype(buf)>::value, buf, &filename)) {
-		WlnAbortWithWin32Error(GetLastError(), L"Failed to locate `%ls' relative to cwd.", path.c_str());
-	}
-	*filename = L'\0';
-	return buf;
+static std::wstring_view WlnMakePathAbsoluteAsDirectory(std::wstring_view path) {
+	auto full{WlnMakePathAbsolute(path)};
+	return full.substr(0, WlnPathFilenameOffset(full, WlnNativePathStyle));
 }
 
-static std::wstring WlnMakePathRelative(const std::wstring& path, const std::wstring& to, bool isDir) {
-	wchar_t rel[LONG_MAX_PATH];
-	if(!PathRelativePathToW(rel, to.c_str(), FILE_ATTRIBUTE_DIRECTORY, path.c_str(), isDir ? FILE_ATTRIBUTE_DIRECTORY : 0)) {
-		WlnAbortWithReason(L"Could not make `%ls' relative to `%ls'.", path.c_str(), to.c_str());
+// Bulk relative links tend to share a directory, so the last one is kept split up.
+static thread_local WlnPathComponents relativeBase;
+
+// WlnMakePathRelative returns the path to path from the directory to; both must be absolute.
+static std::wstring WlnMakePathRelative(std::wstring_view path, std::wstring_view to) {
+	if(relativeBase.path() != to) {
+		relativeBase.assign(to, WlnNativePathStyle);
+	}
+
+	std::wstring rel;
+	if(!WlnMakePathRelative(path, relativeBase, WlnNativePathStyle, WlnNativePathCase, rel)) {
+		WlnAbortWithReason(L"Could not make `%.*ls' relative to `%.*ls'.", static_cast<int>(path.size()), path.data(), static_cast<int>(to.size()), to.data());
 	}
 	return rel;
 }
 
-static std::optional<WIN32_FILE_ATTRIBUTE_DATA> WlnGetAttributes(const std::wstring& path) {
-	WIN32_FILE_ATTRIBUTE_DATA fi{};
-	int ret = GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &fi);
-	int gle = GetLastError();
-	if(!ret && gle != ERROR_FILE_NOT_FOUND) {
-		WlnAbortWithWin32Error(gle, L"Failed to read attributes for `%ls'.", path.c_str());
-	} else if(ret) {
-		return {fi};
+// Every file we look at goes through this cache, so each path is opened once.
+static WlnFileInfoCache fileInfoCache;
+
+// WlnGetFileInfo returns the attributes, reparse tag and ID of path in one
+// query, or nothing if path doesn't exist.
+static std::optional<WlnFileInfo> WlnGetFileInfo(const std::wstring& path) {
+	std::optional<WlnFileInfo> fi;
+	auto full{WlnMakePathAbsolute(path)};
+	int err;
+	{
+		WlnStatTimer timer{WlnStatPhase::QueryFileInfo};
+		err = fileInfoCache.query(full, fi);
 	}
-	return {};
+	if(err) {
+		WlnAbortWithSystemError(err, L"Failed to read attributes for `%ls'.", path.c_str());
+	}
+	return fi;
 }
 
-static std::optional<FILE_ID_INFO> WlnGetFileID(const std::wstring& path) {
-	HANDLE hFile{CreateFileW(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_OPEN_REPARSE_POINT | FILE_FLAG_BACKUP_SEMANTICS, nullptr)};
-	int gle = GetLastError();
-	if(hFile == INVALID_HANDLE_VALUE && gle != ERROR_FILE_NOT_FOUND) {
-		WlnAbortWithWin32Error(gle, L"Failed to open `%ls' for identification.", path.c_str());
-	} else if(hFile) {
-		FILE_ID_INFO id{};
-		auto ret = GetFileInformationByHandleEx(hFile, FileIdInfo, &id, sizeof(id));
-		gle = GetLastError();
-		CloseHandle(hFile);
-		if(!ret) {
-			WlnAbortWithWin32Error(gle, L"Failed to get an ID for `%ls'.", path.c_str());
-		}
-		return {id};
+// This WlnGetFileInfo looks up name in dir (or name itself, without one), which is
+// the absolute path link.
+static std::optional<WlnFileInfo> WlnGetFileInfo(const std::wstring& link, const WlnFsDirectory* dir, const std::wstring& name) {
+	if(!dir) return WlnGetFileInfo(link);
+
+	std::optional<WlnFileInfo> fi;
+	int err;
+	{
+		WlnStatTimer timer{WlnStatPhase::QueryFileInfo};
+		err = fileInfoCache.query(link, *dir, name, fi);
 	}
-	return {};
+	if(err) {
+		WlnAbortWithSystemError(err, L"Failed to read attributes for `%ls'.", link.c_str());
+	}
+	return fi;
 }
 
-static bool WlnIsSameFile(const std::optional<FILE_ID_INFO>& left, const std::optional<FILE_ID_INFO>& right) {
+static std::optional<WlnFileID> WlnGetFileID(const std::wstring& path) {
+	auto fi{WlnGetFileInfo(path)};
+	if(!fi) return {};
+	return {fi->id};
+}
+
+static bool WlnIsSameFile(const std::optional<WlnFileID>& left, const std::optional<WlnFileID>& right) {
 	if((!left && !right) || !left || !right) return false;
 	auto& lid = left.value();
 	auto& rid = right.value();
-	return lid.VolumeSerialNumber == rid.VolumeSerialNumber && memcmp(&lid.FileId.Identifier[0], &rid.FileId.Identifier[0], sizeof(lid.FileId)) == 0;
+	return lid.volume == rid.volume && memcmp(&lid.id[0], &rid.id[0], sizeof(lid.id)) == 0;
 }
 
-static bool WlnIsDirectory(const WIN32_FILE_ATTRIBUTE_DATA& fileInfo) {
-	return fileInfo.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY;
+static bool WlnIsDirectory(const WlnFileInfo& fileInfo) {
+	return fileInfo.attributes & WlnFileAttributeDirectory;
 }
 
-static bool WlnIsDirectory(const std::optional<WIN32_FILE_ATTRIBUTE_DATA>& fileInfo) {
+static bool WlnIsDirectory(const std::optional<WlnFileInfo>& fileInfo) {
 	return fileInfo.has_value() ? WlnIsDirectory(fileInfo.value()) : false;
 }
 
-static bool WlnIsPhysicalDirectory(const WIN32_FILE_ATTRIBUTE_DATA& fileInfo) {
-	return fileInfo.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY && !(fileInfo.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT);
+static bool WlnIsPhysicalDirectory(const WlnFileInfo& fileInfo) {
+	return fileInfo.attributes & WlnFileAttributeDirectory && !(fileInfo.attributes & WlnFileAttributeReparsePoint);
 }
 
-static bool WlnIsPhysicalDirectory(const std::optional<WIN32_FILE_ATTRIBUTE_DATA>& fileInfo) {
+static bool WlnIsPhysicalDirectory(const std::optional<WlnFileInfo>& fileInfo) {
 	return fileInfo.has_value() ? WlnIsPhysicalDirectory(fileInfo.value()) : false;
 }
 
-static std::wstring WlnGetFilename(const std::wstring& path) {
-	auto pos{path.length() - 2}; // 2: skip a potential final / or \. safe because leaf can't be < 1 char in length
-	auto last{path.find_last_of(L"\\/", pos)};
-	if(last == std::wstring::npos) {
-		last = -1;
-	}
-
-	auto leaf{path.substr(last + 1, pos - last + ((path.back() == L'\\' || path.back() == '/') ? 0 : 1))};
-	if(leaf.length() == 2 && leaf[1] == L':') {
-		// SPECIAL CASE: The filename for a drive (C:\) is its name (C)
-		return leaf.substr(0, 1);
-	}
-	return leaf;
-}
-
 static option opts[]{
 	{L"force", L'f', false},
 	{L"symbolic", L's', false},
@@ -170,36 +296,883 @@ static option opts[]{
 	{L"no-target-directory", L'T', false},
 	{L"target-directory", L't', true},
 	{L"verbose", L'v', false},
+	{L"from-file", static_cast<wchar_t>(LongOptionFromFile), true},
+	{L"null", L'0', false},
+	{L"jobs", static_cast<wchar_t>(LongOptionJobs), true},
+	{L"output", static_cast<wchar_t>(LongOptionOutput), true},
+	{L"keep-going", static_cast<wchar_t>(LongOptionKeepGoing), false},
+	{L"skip-identical", static_cast<wchar_t>(LongOptionSkipIdentical), false},
+	{L"atomic", static_cast<wchar_t>(LongOptionAtomic), false},
+	{L"read", static_cast<wchar_t>(LongOptionRead), false},
+	{L"verify", static_cast<wchar_t>(LongOptionVerify), false},
+	{L"dedupe", static_cast<wchar_t>(LongOptionDedupe), true},
+	{L"recursive", static_cast<wchar_t>(LongOptionRecursive), false},
+	{L"transactional", static_cast<wchar_t>(LongOptionTransactional), true},
+	{L"rollback", static_cast<wchar_t>(LongOptionRollback), true},
+	{L"dry-run", static_cast<wchar_t>(LongOptionDryRun), false},
+	{L"stats", static_cast<wchar_t>(LongOptionStats), false},
 	{nullptr, 0, false},
 };
 
-static void WlnCreateLink(LinkType type, DirOption diropt, const std::wstring& target, std::wstring link, bool force, bool relative, bool verbose, const std::optional<WIN32_FILE_ATTRIBUTE_DATA>& linkFileInfo = {});
+static void WlnPlanLink(const std::wstring& target, const std::wstring& linkname, const WlnFsDirectory* dir, const LinkOptions& options, LinkPlan& plan, WlnLinkResult* result, unsigned hints);
+static WlnLinkOutcome WlnExecuteLink(const LinkPlan& plan, const LinkOptions& options);
 
-int wmain(int argc, wchar_t** argv) {
-	bool force = false, relative = false, verbose = false;
+// With --output=jsonl (or --read), one record per link goes here. It's
+// flushed at exit.
+static std::optional<WlnBufferedWriter> resultWriter;
+static bool jsonOutput = false;
+
+static const char* WlnLinkTypeName(LinkType type) {
+	switch(type) {
+	case LinkTypeHard:
+		return "hard";
+	case LinkTypeSymbolic:
+		return "symbolic";
+	case LinkTypeJunction:
+		return "junction";
+	}
+	return "unknown";
+}
+
+// WlnTimeResult runs action, which fills in result, and appends result to json
+// as a record, whether action succeeds or not. Without recordCreated, a link
+// that action leaves to be created isn't recorded yet.
+static void WlnTimeResult(std::string& json, WlnLinkResult& result, const std::function<WlnLinkOutcome()>& action, bool recordCreated = true) {
+	auto start{std::chrono::steady_clock::now()};
+	auto finish = [&]() {
+		result.elapsedMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		WlnAppendJsonLine(result, json);
+	};
+
+	try {
+		result.outcome = action();
+	} catch(const WlnAbortException& e) {
+		result.outcome = WlnLinkOutcome::Failed;
+		result.error = e.error;
+		finish();
+		throw;
+	}
+	if(recordCreated || result.outcome != WlnLinkOutcome::Created) {
+		finish();
+	}
+}
+
+// WlnPlanLinkWithResult calls WlnPlanLink. With json, it also appends the
+// result record for a link that planning settles: one that can't be made, is
+// already in place or verified, or with --dry-run, is planned. The rest are
+// recorded as they're made.
+static void WlnPlanLinkWithResult(std::string* json, const std::wstring& target, const std::wstring& linkname, const WlnFsDirectory* dir, const LinkOptions& options, LinkPlan& plan, unsigned hints = PlanHintNone) {
+	plan.outcome = WlnLinkOutcome::Failed;
+	if(!json) {
+		WlnPlanLink(target, linkname, dir, options, plan, nullptr, hints);
+		return;
+	}
+
+	WlnLinkResult result{linkname, target, WlnLinkTypeName(options.type), WlnLinkOutcome::Failed, 0, 0};
+	WlnTimeResult(*json, result, [&]() {
+		WlnPlanLink(target, linkname, dir, options, plan, &result, hints);
+		if(options.dryRun && plan.outcome == WlnLinkOutcome::Created) {
+			return WlnLinkOutcome::Planned;
+		}
+		return plan.outcome;
+	}, false);
+}
+
+// WlnExecuteLinkWithResult calls WlnExecuteLink. With json, it also appends
+// the result record for the link to it, whether the link was made or not.
+static void WlnExecuteLinkWithResult(std::string* json, const LinkPlan& plan, const LinkOptions& options) {
+	if(!json) {
+		WlnExecuteLink(plan, options);
+		return;
+	}
+
+	WlnLinkResult result{plan.link, plan.target, WlnLinkTypeName(options.type), WlnLinkOutcome::Failed, 0, 0};
+	WlnTimeResult(*json, result, [&]() {
+		return WlnExecuteLink(plan, options);
+	});
+}
+
+// WlnCheckDestination validates link against diropt and returns its attributes
+// (if it exists) for WlnOpenLinkDirectory.
+static std::optional<WlnFileInfo> WlnCheckDestination(DirOption diropt, const std::wstring& link) {
+	auto linkFi{WlnGetFileInfo(link)};
+	if(linkFi && WlnIsDirectory(linkFi.value())) {
+		if(diropt == DirOptionTargetIsFile && WlnIsPhysicalDirectory(linkFi.value())) {
+			// only physical directories (unremoveable even with force) will fail -T
+			WlnAbortWithReason(L"destination `%ls' is a directory, but --no-target-directory was specified", link.c_str());
+		}
+	} else {
+		if(diropt == DirOptionTargetIsDir) {
+			WlnAbortWithReason(L"destination `%ls' is not a directory", link.c_str());
+		}
+		// missing file/file existing is okay here; force is processed later
+	}
+	return linkFi;
+}
+
+// WlnOpenLinkDirectory opens link as dir if the links are going inside it
+// (that is, it's a directory and -T wasn't given). It returns dir, or nullptr
+// if link names the link itself.
+static const WlnFsDirectory* WlnOpenLinkDirectory(DirOption diropt, const std::wstring& link, const std::optional<WlnFileInfo>& linkFileInfo, WlnFsDirectory& dir) {
+	if(diropt == DirOptionTargetIsFile || !WlnIsDirectory(linkFileInfo)) {
+		return nullptr;
+	}
+
+	pathArena.reset();
+	if(int err = dir.open(WlnMakePathAbsolute(link))) {
+		WlnAbortWithSystemError(err, L"Failed to open directory `%ls'.", link.c_str());
+	}
+	return &dir;
+}
+
+// With --keep-going, a link that fails doesn't stop the run. Its error is kept
+// here for WlnReportFailures to summarize at the end.
+static bool keepGoing = false;
+static std::vector<WlnAbortException> failures;
+static size_t linksAttempted = 0;
+
+// With --transactional, every change made is recorded here, so that the
+// whole run can be undone if any of it fails.
+static std::optional<WlnJournal> journal;
+
+// WlnJournalChange records a change before it's made.
+static void WlnJournalChange(WlnJournalOp op, const std::wstring& path, const std::wstring& backup = {}) {
+	if(!journal) return;
+	if(int err = journal->record(WlnJournalRecord{op, path, backup})) {
+		WlnAbortWithSystemError(err, L"Failed to write journal `%ls'.", journal->path().c_str());
+	}
+}
+
+// WlnJournalCancel records that the change just recorded for path failed, so
+// a rollback mustn't undo it.
+static void WlnJournalCancel(const std::wstring& path) {
+	WlnJournalChange(WlnJournalOp::Cancelled, path);
+}
+
+// WlnUndoChanges undoes records, newest first, and returns the ones that couldn't be.
+static std::vector<WlnJournalRecord> WlnUndoChanges(const std::vector<WlnJournalRecord>& records) {
+	std::vector<WlnJournalRecord> remaining;
+	for(auto it = records.rbegin(); it != records.rend(); ++it) {
+		if(int err = WlnUndoJournalRecord(*it)) {
+			WlnPrintDiagnostic(L"%ls: failed to undo the change to `%ls' (error %d)\r\n", WlnGetProgName().c_str(), it->path.c_str(), err);
+			remaining.insert(remaining.begin(), *it);
+		}
+	}
+	return remaining;
+}
+
+// WlnSettleJournal deletes the journal at path if nothing is left to undo, or
+// otherwise leaves it listing only what is, for --rollback to try again.
+static void WlnSettleJournal(const std::wstring& path, const std::vector<WlnJournalRecord>& remaining, size_t undone) {
+	if(remaining.empty()) {
+		WlnFsDeleteFile(nullptr, path);
+		if(undone) {
+			WlnPrintDiagnostic(L"%ls: rolled back %zu changes\r\n", WlnGetProgName().c_str(), undone);
+		}
+		return;
+	}
+	WlnWriteJournal(path, remaining);
+	WlnPrintDiagnostic(L"%ls: rolled back %zu changes; `%ls' lists the %zu that couldn't be\r\n", WlnGetProgName().c_str(), undone, path.c_str(), remaining.size());
+}
+
+// WlnRollBack undoes the transaction. It's the abort handler while one is running.
+static void WlnRollBack() {
+	journal->close();
+	auto remaining{WlnUndoChanges(journal->records())};
+	WlnSettleJournal(journal->path(), remaining, journal->records().size() - remaining.size());
+}
+
+// WlnAtAbort is the abort handler for runs with something to finish off on
+// the way out: it rolls back the transaction, if there's one going, and prints
+// --stats.
+static void WlnAtAbort() {
+	if(journal) {
+		WlnRollBack();
+		journal.reset();
+	}
+	WlnPrintStats();
+}
+
+// WlnBeginTransaction starts journaling to path; from here on, a failure
+// rolls everything back.
+static void WlnBeginTransaction(const std::wstring& path) {
+	if(WlnGetFileInfo(path)) {
+		WlnAbortWithReason(L"journal `%ls' already exists; undo what it lists with --rollback", path.c_str());
+	}
+	journal.emplace();
+	if(int err = journal->create(path)) {
+		WlnAbortWithSystemError(err, L"Failed to create journal `%ls'.", path.c_str());
+	}
+	fileInfoCache.invalidate(path);
+	WlnSetAbortHandler(WlnAtAbort);
+}
+
+// WlnRollBackJournal undoes what a --transactional run left in the journal
+// at path, and returns the exit code for --rollback.
+static int WlnRollBackJournal(const std::wstring& path) {
+	std::vector<WlnJournalRecord> records;
+	if(int err = WlnReadJournal(path, records)) {
+		WlnAbortWithSystemError(err, L"Failed to read journal `%ls'.", path.c_str());
+	}
+	auto remaining{WlnUndoChanges(records)};
+	WlnSettleJournal(path, remaining, records.size() - remaining.size());
+	return remaining.empty() ? 0 : 1;
+}
+
+// WlnCommit keeps the transaction's changes: the files -f displaced go for
+// good, and so does the journal.
+static void WlnCommit() {
+	journal->close();
+	for(auto& record : journal->records()) {
+		if(record.op != WlnJournalOp::Displaced) continue;
+		if(WlnFsRemoveDirectory(nullptr, record.backup) != 0) {
+			if(int err = WlnFsDeleteFile(nullptr, record.backup)) {
+				WlnPrintDiagnostic(L"%ls: failed to remove `%ls' (error %d)\r\n", WlnGetProgName().c_str(), record.backup.c_str(), err);
+			}
+		}
+	}
+	WlnFsDeleteFile(nullptr, journal->path());
+}
+
+// WlnFinishRun commits or rolls back the transaction (if there is one),
+// depending on the run's exit code.
+static int WlnFinishRun(int status) {
+	if(!journal) return status;
+	if(status == 0) {
+		WlnCommit();
+	} else {
+		WlnRollBack();
+	}
+	journal.reset();
+	return status;
+}
+
+// WlnRunJob runs one item of WlnRunJobs with its output captured, and returns
+// the error that failed it, if any.
+static std::optional<WlnAbortException> WlnRunJob(size_t i, const std::function<void(size_t, std::string*)>& work, std::wstring& output, std::string* result) {
+	WlnOutputCapture capture{output};
+	try {
+		work(i, result);
+	} catch(WlnAbortException& e) {
+		return std::move(e);
+	}
+	return {};
+}
+
+// WlnFinishJob replays one item's output and result record, then exits if it
+// failed (or, with --keep-going, records the failure).
+static void WlnFinishJob(const std::wstring& output, const std::string* result, std::optional<WlnAbortException>& error) {
+	if(!output.empty()) {
+		WlnPrintDiagnostic(L"%ls", output.c_str());
+	}
+	if(result) {
+		resultWriter->write(*result);
+	}
+	if(!error) return;
+
+	if(!keepGoing) {
+		WlnExitWithFailure();
+	}
+	// Not every abort message ends its line; the next link's output shouldn't run on.
+	if(!output.empty() && output.back() != L'\n') {
+		WlnPrintDiagnostic(L"\r\n");
+	}
+	failures.emplace_back(std::move(error.value()));
+}
+
+// WlnRunJobs calls work(i, result) for every i in [0, count) on jobs threads.
+// Each item's output, result record (with --output) and failure are replayed in
+// index order afterwards, so the console looks just like a serial run that
+// stopped at the first failing item. Unless we're keeping going, items after
+// the first known failure are not started.
+static void WlnRunJobs(size_t count, unsigned jobs, const std::function<void(size_t, std::string*)>& work) {
+	if(jobs <= 1) {
+		if(!resultWriter && !keepGoing) {
+			for(size_t i = 0; i < count; ++i) {
+				work(i, nullptr);
+			}
+			return;
+		}
+
+		std::wstring output;
+		std::string result;
+		for(size_t i = 0; i < count; ++i) {
+			output.clear();
+			result.clear();
+			auto error{WlnRunJob(i, work, output, resultWriter ? &result : nullptr)};
+			WlnFinishJob(output, resultWriter ? &result : nullptr, error);
+		}
+		return;
+	}
+
+	std::vector<std::wstring> output(count);
+	std::vector<std::string> results(resultWriter ? count : 0);
+	std::vector<std::optional<WlnAbortException>> errors(count);
+	std::atomic<size_t> firstFailure{count};
+	WlnParallelFor(count, jobs, [&](size_t i) {
+		if(i > firstFailure.load(std::memory_order_relaxed)) return;
+
+		errors[i] = WlnRunJob(i, work, output[i], resultWriter ? &results[i] : nullptr);
+		if(errors[i] && !keepGoing) {
+			size_t prev = firstFailure.load();
+			while(i < prev && !firstFailure.compare_exchange_weak(prev, i));
+		}
+	});
+
+	for(size_t i = 0; i < count; ++i) {
+		WlnFinishJob(output[i], resultWriter ? &results[i] : nullptr, errors[i]);
+	}
+}
+
+// WlnReportFailures summarizes the failures --keep-going carried on past (or
+// mismatches --verify found), and returns the exit code for the run. Each
+// mismatch was printed as it was found, so --verify only counts them.
+static int WlnReportFailures(bool verify = false) {
+	if(failures.empty()) return 0;
+
+	if(verify) {
+		WlnPrintDiagnostic(L"%ls: %zu of %zu links don't match\r\n", WlnGetProgName().c_str(), failures.size(), linksAttempted);
+		return 1;
+	}
+	WlnPrintDiagnostic(L"%ls: %zu of %zu links failed:\r\n", WlnGetProgName().c_str(), failures.size(), linksAttempted);
+	for(auto& failure : failures) {
+		std::wstring_view message{failure.message};
+		while(!message.empty() && (message.back() == L'\n' || message.back() == L'\r')) {
+			message.remove_suffix(1);
+		}
+		WlnPrintDiagnostic(L"  %.*ls\r\n", static_cast<int>(message.size()), message.data());
+	}
+	return 1;
+}
+
+// Manifests (and --recursive walks) are planned in batches of this many records.
+static constexpr size_t WlnManifestBatchSize = 4096;
+
+// Links are made in runs that go into this many directories at most, each
+// opened just once.
+static constexpr size_t WlnExecuteDirectoryBatchSize = 64;
+
+// A RunPlan is every change a run is going to make: the directories
+// --recursive has to create (parents first), then the links.
+struct RunPlan {
+	std::vector<std::wstring> directories;
+	std::vector<LinkPlan> links;
+};
+
+// WlnPlanLinks plans count more links into plan on jobs threads, calling
+// planOne(i, result, link) for each. A link that can't be made stops the run
+// before anything has changed (or with --keep-going, is left out of it).
+static void WlnPlanLinks(RunPlan& plan, size_t count, unsigned jobs, const std::function<void(size_t, std::string*, LinkPlan&)>& planOne) {
+	linksAttempted += count;
+	size_t first = plan.links.size();
+	plan.links.resize(first + count);
+	for(size_t i = first; i < plan.links.size(); ++i) {
+		plan.links[i].outcome = WlnLinkOutcome::Failed;
+	}
+	WlnRunJobs(count, jobs, [&](size_t i, std::string* result) {
+		planOne(i, result, plan.links[first + i]);
+	});
+}
+
+// WlnCreateMirrorDirectory creates the directory at path (absolute) that
+// --recursive planned.
+static void WlnCreateMirrorDirectory(const std::wstring& path, const LinkOptions& options) {
+	WlnJournalChange(WlnJournalOp::CreatedDirectory, path);
+	int err;
+	{
+		WlnStatTimer timer{WlnStatPhase::CreateDirectory};
+		err = WlnFsCreateDirectory(nullptr, path);
+	}
+	if(err) {
+		WlnJournalCancel(path);
+		WlnAbortWithSystemError(err, L"Failed to create directory `%ls'.", path.c_str());
+	}
+	fileInfoCache.invalidate(path);
+	if(options.verbose) {
+		WlnPrintDiagnostic(L"created directory `%ls'\r\n", path.c_str());
+	}
+}
+
+// WlnExecutePlan makes the changes in plan: the directories first, then the
+// links, in plan order so that output and failures come out as they would
+// one at a time. Links are made in runs that go into at most
+// WlnExecuteDirectoryBatchSize directories, each opened once for the run, and
+// relative to it, on jobs threads.
+static void WlnExecutePlan(RunPlan& plan, const LinkOptions& options, unsigned jobs) {
+	for(auto& directory : plan.directories) {
+		WlnCreateMirrorDirectory(directory, options);
+	}
+
+	std::unordered_map<std::wstring, std::unique_ptr<WlnFsDirectory>> dirs;
+	std::vector<size_t> batch;
+	size_t next = 0;
+	while(next < plan.links.size()) {
+		batch.clear();
+		dirs.clear();
+		for(; next < plan.links.size() && batch.size() < WlnManifestBatchSize; ++next) {
+			auto& link = plan.links[next];
+			if(link.outcome != WlnLinkOutcome::Created) continue;
+			if(link.dir) {
+				batch.push_back(next);
+				continue;
+			}
+
+			size_t leaf = WlnPathFilenameOffset(link.link, WlnNativePathStyle);
+			std::wstring parent{link.link, 0, leaf};
+			auto found{dirs.find(parent)};
+			if(found == dirs.end()) {
+				if(dirs.size() == WlnExecuteDirectoryBatchSize) break;
+				auto dir{std::make_unique<WlnFsDirectory>()};
+				// If it can't be opened, the links still can be made by their full
+				// paths, or fail with a better error.
+				if(dir->open(parent) != 0) {
+					dir.reset();
+				}
+				found = dirs.emplace(std::move(parent), std::move(dir)).first;
+			}
+			if(found->second) {
+				link.dir = found->second.get();
+				link.name.assign(link.link, leaf, std::wstring::npos);
+			}
+			batch.push_back(next);
+		}
+
+		WlnRunJobs(batch.size(), jobs, [&](size_t i, std::string* result) {
+			WlnExecuteLinkWithResult(result, plan.links[batch[i]], options);
+		});
+	}
+}
+
+// WlnAppendPlanLine appends one line of --dry-run output, as UTF-8, to out.
+static void WlnAppendPlanLine(std::string& out, const wchar_t* action, const std::wstring& path, const std::wstring* target) {
+	std::wstring line{action};
+	line += L" `";
+	line += path;
+	line += L'\'';
+	if(target) {
+		line += L" -> `";
+		line += *target;
+		line += L'\'';
+	}
+	std::string utf8;
+	if(!WlnWideToUtf8(line.data(), line.size(), utf8)) {
+		WlnAbortWithReason(L"`%ls' can't be written as UTF-8", path.c_str());
+	}
+	out += utf8;
+	out += '\n';
+}
+
+// WlnPrintPlan writes the changes in plan to standard output for --dry-run,
+// one per line. With --output=jsonl, planning has recorded the links already.
+static void WlnPrintPlan(const RunPlan& plan) {
+	if(jsonOutput) return;
+
+	std::string out;
+	for(auto& directory : plan.directories) {
+		WlnAppendPlanLine(out, L"create directory", directory, nullptr);
+	}
+	for(auto& link : plan.links) {
+		if(link.outcome != WlnLinkOutcome::Created) continue;
+		WlnAppendPlanLine(out, link.destFi ? L"replace" : L"link", link.link, &link.target);
+	}
+	WlnBufferedWriter{stdout}.write(out);
+}
+
+// WlnCarryOutPlan makes the changes in plan, or for --dry-run, prints them.
+// (--verify has already done everything it came for.)
+static void WlnCarryOutPlan(RunPlan& plan, const LinkOptions& options, unsigned jobs) {
+	if(options.verify) return;
+	if(options.dryRun) {
+		WlnPrintPlan(plan);
+		return;
+	}
+	// A transaction that --keep-going planned past a failure in would only be
+	// rolled back.
+	if(journal && !failures.empty()) return;
+	WlnExecutePlan(plan, options, jobs);
+}
+
+// WlnCreateLinksFromManifest creates every link listed in manifest in this
+// process, planning and then making them a batch at a time. Records without a
+// link name go into linkdir (from -t).
+static void WlnCreateLinksFromManifest(const std::wstring& manifest, bool nulSeparated, DirOption diropt, const std::optional<std::wstring>& linkdir, const LinkOptions& options, unsigned jobs) {
+	WlnFsDirectory linkdirHandle;
+	const WlnFsDirectory* linkdirDir = nullptr;
+	if(linkdir) {
+		auto linkdirFi{WlnCheckDestination(DirOptionTargetIsDir, linkdir.value())};
+		linkdirDir = WlnOpenLinkDirectory(DirOptionTargetIsDir, linkdir.value(), linkdirFi, linkdirHandle);
+	}
+
+	struct numberedRecord {
+		WlnManifestRecord record;
+		size_t number;
+	};
+
+	auto planOne = [&](const numberedRecord& r, std::string* result, LinkPlan& plan) {
+		auto& record = r.record;
+		if(record.target.empty()) {
+			WlnAbortWithReason(L"%ls: record %zu: missing target", manifest.c_str(), r.number);
+		}
+
+		if(record.link.empty()) {
+			if(!linkdir) {
+				WlnAbortWithReason(L"%ls: record %zu: missing link name", manifest.c_str(), r.number);
+			}
+			WlnPlanLinkWithResult(result, record.target, linkdir.value(), linkdirDir, options, plan);
+			return;
+		}
+
+		auto linkFi{WlnCheckDestination(diropt == DirOptionTargetIsFile ? diropt : DirOptionTargetDontCare, record.link)};
+		if(diropt == DirOptionTargetIsFile || !WlnIsDirectory(linkFi)) {
+			WlnPlanLinkWithResult(result, record.target, record.link, nullptr, options, plan);
+			return;
+		}
+		// The link goes inside it, named after the target.
+		std::wstring inside{WlnMakePathAbsolute(record.link)};
+		if(inside.back() != WLN_PATH_SEPARATOR) {
+			inside += WLN_PATH_SEPARATOR;
+		}
+		inside += WlnPathLeaf(WlnMakePathAbsolute(record.target));
+		WlnPlanLinkWithResult(result, record.target, inside, nullptr, options, plan);
+	};
+
+	// Planning looks at what's on disk, so a record whose target (or either
+	// one's directory) is the link of a record in the batch, or that links at
+	// the same place again, has to wait for the batch to be made. pending holds
+	// the absolute paths the batch links at, without trailing separators; a
+	// record naming a directory might link inside it, so both are kept.
+	std::unordered_set<std::wstring> pending;
+	auto absolute = [](std::wstring_view path) {
+		std::wstring full{WlnMakePathAbsolute(path)};
+		if(full.size() > WlnPathRootLength(full, WlnNativePathStyle) && full.back() == WLN_PATH_SEPARATOR) {
+			full.pop_back();
+		}
+		return full;
+	};
+	auto parent = [](const std::wstring& path) {
+		std::wstring_view dir{path.data(), WlnPathFilenameOffset(path, WlnNativePathStyle)};
+		if(dir.size() > WlnPathRootLength(dir, WlnNativePathStyle) && dir.back() == WLN_PATH_SEPARATOR) {
+			dir.remove_suffix(1);
+		}
+		return std::wstring{dir};
+	};
+	std::vector<std::wstring> links;
+	auto waits = [&](const WlnManifestRecord& record) {
+		pathArena.reset();
+		links.clear();
+		if(record.target.empty()) return false;
+		auto target{absolute(record.target)};
+		std::wstring leaf{WlnPathLeaf(target)};
+		if(!record.link.empty()) {
+			links.push_back(absolute(record.link));
+			links.push_back(links.back() + WLN_PATH_SEPARATOR + leaf);
+		} else if(linkdir) {
+			links.push_back(absolute(linkdir.value()) + WLN_PATH_SEPARATOR + leaf);
+		}
+
+		bool depends = pending.count(target) || pending.count(parent(target));
+		for(auto& link : links) {
+			depends = depends || pending.count(link) || pending.count(parent(link));
+		}
+		return depends;
+	};
+
+	WlnManifestReader reader{manifest, nulSeparated};
+	std::vector<numberedRecord> batch(WlnManifestBatchSize);
+	size_t n = 0;
+	auto flush = [&]() {
+		RunPlan plan;
+		WlnPlanLinks(plan, n, jobs, [&](size_t i, std::string* result, LinkPlan& link) {
+			planOne(batch[i], result, link);
+		});
+		WlnCarryOutPlan(plan, options, jobs);
+		pending.clear();
+		n = 0;
+	};
+	while(reader.next(batch[n].record)) {
+		batch[n].number = reader.get_record();
+		if(waits(batch[n].record)) {
+			size_t last = n;
+			flush();
+			std::swap(batch[0], batch[last]);
+		}
+		for(auto& link : links) {
+			pending.insert(std::move(link));
+		}
+		if(++n == WlnManifestBatchSize) {
+			flush();
+		}
+	}
+	if(n > 0) {
+		flush();
+	}
+}
+
+// WlnReadLink puts where the link at path points into out: a line holding just
+// the target, like readlink, or a result record with --output=jsonl.
+static void WlnReadLink(const std::wstring& path, std::string& out) {
+	pathArena.reset();
+	std::wstring link{WlnMakePathAbsolute(path)};
+
+	WlnLinkResult result{link, {}, "unknown", WlnLinkOutcome::Failed, 0, 0};
+	auto read = [&]() {
+		auto fi{WlnGetFileInfo(link)};
+		if(fi && fi->reparseTag == WlnReparseTagSymlink) {
+			result.type = WlnLinkTypeName(LinkTypeSymbolic);
+		} else if(fi && fi->reparseTag == WlnReparseTagMountPoint) {
+			result.type = WlnLinkTypeName(LinkTypeJunction);
+		}
+
+		if(int err = WlnFsReadLink(nullptr, link, result.target)) {
+			WlnAbortWithSystemError(err, L"Failed to read link `%ls'.", path.c_str());
+		}
+		return WlnLinkOutcome::Read;
+	};
+
+	if(jsonOutput) {
+		WlnTimeResult(out, result, read);
+		return;
+	}
+
+	read();
+	static thread_local std::string utf8;
+	if(!WlnWideToUtf8(result.target.data(), result.target.size(), utf8)) {
+		WlnAbortWithReason(L"`%ls' points to a name that can't be written as UTF-8", path.c_str());
+	}
+	out += utf8;
+	out += '\n';
+}
+
+// WlnReadLinks reads every link in paths, or named by the manifest (the link
+// field of each record, or the only one), printing results in order.
+static void WlnReadLinks(const std::vector<std::wstring>& paths, const std::optional<std::wstring>& manifest, bool nulSeparated, unsigned jobs) {
+	if(!manifest) {
+		linksAttempted += paths.size();
+		WlnRunJobs(paths.size(), jobs, [&](size_t i, std::string* result) {
+			WlnReadLink(paths[i], *result);
+		});
+		return;
+	}
+
+	WlnManifestReader reader{manifest.value(), nulSeparated};
+	std::vector<WlnManifestRecord> batch(jobs > 1 ? WlnManifestBatchSize : 1);
+	for(;;) {
+		size_t n = 0;
+		while(n < batch.size() && reader.next(batch[n])) {
+			++n;
+		}
+		if(n == 0) break;
+
+		linksAttempted += n;
+		WlnRunJobs(n, jobs, [&](size_t i, std::string* result) {
+			WlnReadLink(batch[i].link.empty() ? batch[i].target : batch[i].link, *result);
+		});
+	}
+}
+
+// WlnDedupe replaces every duplicate file under root with a hard link.
+static void WlnDedupe(const std::wstring& root, LinkOptions options, unsigned jobs) {
+	auto rootFi{WlnGetFileInfo(root)};
+	if(!WlnIsPhysicalDirectory(rootFi)) {
+		WlnAbortWithReason(L"`%ls' is not a directory", root.c_str());
+	}
+
+	// The duplicates are there to be replaced, and someone could be reading
+	// them. If one has become a link to its original since we looked, fine.
+	// (A transaction keeps them anyway, until it's over.)
+	options.type = LinkTypeHard;
+	options.force = true;
+	options.atomic = !journal;
+	options.skipIdentical = true;
+
+	auto duplicates{WlnFindDuplicates(std::wstring{WlnMakePathAbsolute(root)}, jobs)};
+	RunPlan plan;
+	WlnPlanLinks(plan, duplicates.size(), jobs, [&](size_t i, std::string* result, LinkPlan& link) {
+		WlnPlanLinkWithResult(result, duplicates[i].original, duplicates[i].duplicate, nullptr, options, link, PlanHintTargetIsFile);
+	});
+	WlnCarryOutPlan(plan, options, jobs);
+}
+
+// WlnIsPathInside returns whether path is dir or something under it; both
+// must be absolute and normalized.
+static bool WlnIsPathInside(std::wstring_view path, std::wstring_view dir) {
+	WlnPathComponents base;
+	base.assign(dir, WlnNativePathStyle);
+	std::wstring rel;
+	if(!WlnMakePathRelative(path, base, WlnNativePathStyle, WlnNativePathCase, rel)) return false;
+	if(rel == L".") return true;
+	return !(rel.compare(0, 2, L"..") == 0 && (rel.size() == 2 || WlnIsPathSeparator(rel[2], WlnNativePathStyle)));
+}
+
+// WlnPlanMirrorDirectory makes sure there'll be a directory at path
+// (absolute) for --recursive to link files into, and returns whether it has
+// to be created first.
+static bool WlnPlanMirrorDirectory(const std::wstring& path, const LinkOptions& options, RunPlan& plan) {
+	auto fi{WlnGetFileInfo(path)};
+	if(WlnIsPhysicalDirectory(fi)) return false;
+	if(fi) {
+		WlnAbortWithReason(L"cannot overwrite non-directory `%ls' with a directory", path.c_str());
+	}
+	// Everything that should be inside it will be reported missing.
+	if(!options.verify) {
+		plan.directories.push_back(path);
+	}
+	return true;
+}
+
+// WlnMirrorTree recreates every directory under source beneath destination,
+// and links everything else (files and links alike) to its counterpart. The
+// links are planned in batches as the walk goes, and nothing is changed until
+// it's over. Nothing under a directory that's yet to be created needs looking
+// up.
+static void WlnMirrorTree(const std::wstring& source, const std::wstring& destination, const LinkOptions& options, unsigned jobs) {
+	std::wstring sourcePath{WlnMakePathAbsolute(source)};
+	if(!WlnIsPhysicalDirectory(WlnGetFileInfo(sourcePath))) {
+		WlnAbortWithReason(L"`%ls' is not a directory", source.c_str());
+	}
+	std::wstring destinationPath{WlnMakePathAbsolute(destination)};
+	if(WlnIsPathInside(destinationPath, sourcePath)) {
+		WlnAbortWithReason(L"cannot mirror `%ls' into itself, `%ls'", source.c_str(), destination.c_str());
+	}
+	RunPlan plan;
+	bool destinationIsNew = WlnPlanMirrorDirectory(destinationPath, options, plan);
+	if(destinationPath.back() != WLN_PATH_SEPARATOR) {
+		destinationPath += WLN_PATH_SEPARATOR;
+	}
+
+	// The walk is depth first, so once it leaves newRoot (the outermost new
+	// directory it's in) it's gone for good.
+	std::wstring newRoot{destinationIsNew ? destinationPath : std::wstring{}};
+
+	struct pendingLink {
+		std::wstring target;
+		std::wstring link;
+		unsigned hints;
+	};
+	std::vector<pendingLink> batch;
+	batch.reserve(WlnManifestBatchSize);
+	auto flush = [&]() {
+		WlnPlanLinks(plan, batch.size(), jobs, [&](size_t i, std::string* result, LinkPlan& link) {
+			WlnPlanLinkWithResult(result, batch[i].target, batch[i].link, nullptr, options, link, batch[i].hints);
+		});
+		batch.clear();
+	};
+
+	WlnWalkTree(sourcePath, 0, [&](const WlnWalkEntry& entry) {
+		std::wstring link{destinationPath};
+		link += entry.relative;
+		bool isNew = !newRoot.empty() && link.compare(0, newRoot.size(), newRoot) == 0;
+		if(!isNew) {
+			newRoot.clear();
+		}
+		if(WlnIsPhysicalDirectory(entry.info)) {
+			if(isNew) {
+				if(!options.verify) {
+					plan.directories.push_back(link);
+				}
+			} else if(WlnPlanMirrorDirectory(link, options, plan)) {
+				newRoot = link + WLN_PATH_SEPARATOR;
+			}
+			return;
+		}
+
+		unsigned hints = isNew ? PlanHintNewDestination : PlanHintNone;
+		if(!(entry.info.attributes & WlnFileAttributeDirectory)) {
+			hints |= PlanHintTargetIsFile;
+		}
+		batch.push_back(pendingLink{entry.path, std::move(link), hints});
+		if(batch.size() == WlnManifestBatchSize) {
+			flush();
+		}
+	});
+	flush();
+	WlnCarryOutPlan(plan, options, jobs);
+}
+
+// WlnOptions returns opts for parsing CharT arguments. Option names are
+// ASCII, so the narrow table is opts with each name narrowed, made once.
+template<typename CharT>
+static const basic_option<CharT>* WlnOptions() {
+	if constexpr(std::is_same<CharT, wchar_t>::value) {
+		return opts;
+	} else {
+		static std::vector<std::string> names;
+		static std::vector<basic_option<char>> narrowOpts;
+		if(narrowOpts.empty()) {
+			for(auto opt = opts; opt->name; ++opt) {
+				names.emplace_back(opt->name, opt->name + wcslen(opt->name));
+			}
+			for(size_t i = 0; i < names.size(); ++i) {
+				narrowOpts.push_back({names[i].c_str(), opts[i].shopt, opts[i].has_arg});
+			}
+			narrowOpts.push_back({nullptr, 0, false});
+		}
+		return narrowOpts.data();
+	}
+}
+
+// WlnWidenArgument returns arg (which may be null) as a wide string: as it
+// is, or converted from UTF-8 into buffer.
+static const wchar_t* WlnWidenArgument(const wchar_t* arg, std::wstring&) {
+	return arg;
+}
+
+static const wchar_t* WlnWidenArgument(const char* arg, std::wstring& buffer) {
+	if(!arg) return nullptr;
+	if(!WlnUtf8ToWide(arg, strlen(arg), buffer)) {
+		WlnAbortWithReason(L"an argument is not valid UTF-8");
+	}
+	return buffer.c_str();
+}
+
+// WlnMain runs winln on argv, wide (from wmain) or UTF-8 (from a POSIX main,
+// which only widens the arguments it keeps).
+template<typename CharT>
+static int WlnMain(int argc, CharT** argv) {
+	if constexpr(std::is_same<CharT, wchar_t>::value) {
+		// @file arguments are replaced by the arguments in file.
+		static responsefiles responseFiles;
+		const wchar_t* responseFile = nullptr;
+		if(int err = responseFiles.expand(argc, argv, &responseFile)) {
+			WlnAbortWithSystemError(err, L"Failed to read response file `%ls'.", responseFile);
+		}
+	}
+
+	LinkOptions linkopts{LinkTypeHard, false, false, false, false, false, false, false};
+	bool nulSeparated = false;
 	DirOption diropt = DirOptionTargetDontCare;
-	LinkType linktyp = LinkTypeHard;
 	std::optional<std::wstring> linkname;
-	while(int o = getopt_long(argc, argv, opts)) {
-		switch(o) {
-		case -1:
-			goto opts_done;
+	std::optional<std::wstring> manifest;
+	std::optional<std::wstring> dedupeRoot;
+	bool recursive = false;
+	std::optional<std::wstring> journalPath;
+	std::optional<std::wstring> rollbackPath;
+	unsigned jobs = 1;
+	// Installed (or aliased) as readlink, we read links instead of making them.
+	bool readLinks = WlnIsProgName(L"readlink");
+	basic_optparser<CharT> parser{argc, argv, WlnOptions<CharT>()};
+	std::wstring optargBuffer;
+	for(;;) {
+		auto result{parser.parse()};
+		if(result.option == -1) break;
+		const wchar_t* optarg = WlnWidenArgument(result.arg, optargBuffer);
+		switch(result.option) {
 		case 'f':
-			force = true;
+			linkopts.force = true;
 			break;
 		case 'h':
 			WlnAbortWithUsage();
 			return 0;
 		case 'j':
-			if(linktyp == LinkTypeSymbolic) WlnAbortWithArgumentError(L"cannot use --junction with --symbolic");
-			linktyp = LinkTypeJunction;
+			if(linkopts.type == LinkTypeSymbolic) WlnAbortWithArgumentError(L"cannot use --junction with --symbolic");
+			linkopts.type = LinkTypeJunction;
 			break;
 		case 'r':
-			relative = true;
+			linkopts.relative = true;
 			break;
 		case 's':
-			if(linktyp == LinkTypeJunction) WlnAbortWithArgumentError(L"cannot use --symbolic with --junction");
-			linktyp = LinkTypeSymbolic;
+			if(linkopts.type == LinkTypeJunction) WlnAbortWithArgumentError(L"cannot use --symbolic with --junction");
+			linkopts.type = LinkTypeSymbolic;
 			break;
 		case 'T':
 			if(diropt == DirOptionTargetIsDir) WlnAbortWithArgumentError(L"cannot use --no-target-directory with --target-directory=");
@@ -211,18 +1184,179 @@ int wmain(int argc, wchar_t** argv) {
 			linkname.emplace(optarg);
 			break;
 		case 'v':
-			verbose = true;
+			linkopts.verbose = true;
+			break;
+		case '0':
+			nulSeparated = true;
+			break;
+		case LongOptionFromFile:
+			manifest.emplace(optarg);
+			break;
+		case LongOptionJobs: {
+			wchar_t* end = nullptr;
+			unsigned long n = wcstoul(optarg, &end, 10);
+			if(!*optarg || *end || n > 1024) WlnAbortWithArgumentError(L"invalid number of jobs: `%ls'", optarg);
+			jobs = n ? static_cast<unsigned>(n) : WlnDefaultJobs();
+			break;
+		}
+		case LongOptionOutput:
+			if(wcscmp(optarg, L"jsonl") == 0) {
+				jsonOutput = true;
+			} else if(wcscmp(optarg, L"text") == 0) {
+				jsonOutput = false;
+			} else {
+				WlnAbortWithArgumentError(L"invalid output format: `%ls'", optarg);
+			}
+			break;
+		case LongOptionKeepGoing:
+			keepGoing = true;
+			break;
+		case LongOptionSkipIdentical:
+			linkopts.skipIdentical = true;
+			break;
+		case LongOptionAtomic:
+			linkopts.atomic = true;
+			break;
+		case LongOptionRead:
+			readLinks = true;
+			break;
+		case LongOptionVerify:
+			// every mismatch is worth knowing about, not just the first
+			linkopts.verify = true;
+			keepGoing = true;
+			break;
+		case LongOptionDedupe:
+			dedupeRoot.emplace(optarg);
+			break;
+		case LongOptionRecursive:
+			recursive = true;
+			break;
+		case LongOptionTransactional:
+			journalPath.emplace(WlnMakePathAbsolute(optarg));
+			break;
+		case LongOptionRollback:
+			rollbackPath.emplace(WlnMakePathAbsolute(optarg));
+			break;
+		case LongOptionDryRun:
+			linkopts.dryRun = true;
+			break;
+		case LongOptionStats:
+			wlnStatsEnabled = true;
 			break;
 		}
 	}
-opts_done:
 
-	if(relative && linktyp != LinkTypeSymbolic) {
+	if(linkopts.relative && linkopts.type != LinkTypeSymbolic) {
 		WlnAbortWithArgumentError(L"cannot do --relative without --symbolic");
 		return 1;
 	}
 
-	std::vector<std::wstring> targets{argv + optind, argv + argc};
+	if(linkopts.atomic && !linkopts.force) {
+		WlnAbortWithArgumentError(L"cannot do --atomic without --force");
+		return 1;
+	}
+
+	if(journalPath && linkopts.atomic) {
+		// a transaction keeps what -f replaces aside, instead
+		WlnAbortWithArgumentError(L"cannot use --transactional with --atomic");
+		return 1;
+	}
+
+	if(journalPath && (readLinks || linkopts.verify || linkopts.dryRun)) {
+		WlnAbortWithArgumentError(L"cannot use --transactional with --read, --verify or --dry-run");
+		return 1;
+	}
+
+	if(linkopts.dryRun && (readLinks || linkopts.verify || rollbackPath)) {
+		WlnAbortWithArgumentError(L"cannot use --dry-run with --read, --verify or --rollback");
+		return 1;
+	}
+
+	std::vector<std::wstring> targets;
+	for(int i = parser.get_index(); i < argc; ++i) {
+		targets.emplace_back(WlnWidenArgument(argv[i], optargBuffer));
+	}
+
+	if(wlnStatsEnabled) {
+		WlnSetAbortHandler(WlnAtAbort);
+	}
+
+	if(rollbackPath) {
+		if(!targets.empty()) {
+			WlnAbortWithArgumentError(L"extra operand `%ls' with --rollback", targets[0].c_str());
+			return 1;
+		}
+		return WlnRollBackJournal(rollbackPath.value());
+	}
+
+	if(readLinks) {
+		if(manifest && !targets.empty()) {
+			WlnAbortWithArgumentError(L"extra operand `%ls' with --from-file", targets[0].c_str());
+			return 1;
+		}
+		if(!manifest && targets.empty()) {
+			WlnAbortWithArgumentError(L"missing file operand");
+			return 1;
+		}
+		resultWriter.emplace(stdout);
+		WlnReadLinks(targets, manifest, nulSeparated, jobs);
+		return WlnReportFailures();
+	}
+
+	if(jsonOutput) {
+		resultWriter.emplace(stdout);
+	}
+
+	if(journalPath) {
+		WlnBeginTransaction(journalPath.value());
+	}
+
+	if(dedupeRoot) {
+		if(linkopts.type != LinkTypeHard) {
+			WlnAbortWithArgumentError(L"cannot use --dedupe with --symbolic or --junction");
+			return 1;
+		}
+		if(manifest || !targets.empty()) {
+			WlnAbortWithArgumentError(L"extra operand with --dedupe");
+			return 1;
+		}
+		WlnDedupe(dedupeRoot.value(), linkopts, jobs);
+		return WlnFinishRun(WlnReportFailures());
+	}
+
+	if(recursive) {
+		if(linkopts.type == LinkTypeJunction) {
+			WlnAbortWithArgumentError(L"cannot use --recursive with --junction");
+			return 1;
+		}
+		if(manifest || linkname) {
+			WlnAbortWithArgumentError(L"cannot use --recursive with --from-file or --target-directory=");
+			return 1;
+		}
+		if(targets.empty()) {
+			WlnAbortWithArgumentError(L"missing file operand");
+			return 1;
+		}
+		if(targets.size() < 2) {
+			WlnAbortWithArgumentError(L"missing destination file operand after `%ls'", targets[0].c_str());
+			return 1;
+		}
+		if(targets.size() > 2) {
+			WlnAbortWithArgumentError(L"extra operand `%ls'", targets[2].c_str());
+			return 1;
+		}
+		WlnMirrorTree(targets[0], targets[1], linkopts, jobs);
+		return WlnFinishRun(WlnReportFailures(linkopts.verify));
+	}
+
+	if(manifest) {
+		if(!targets.empty()) {
+			WlnAbortWithArgumentError(L"extra operand `%ls' with --from-file", targets[0].c_str());
+			return 1;
+		}
+		WlnCreateLinksFromManifest(manifest.value(), nulSeparated, diropt, linkname, linkopts, jobs);
+		return WlnFinishRun(WlnReportFailures(linkopts.verify));
+	}
 
 	if(targets.empty()) {
 		WlnAbortWithArgumentError(L"missing file operand");
@@ -247,140 +1381,333 @@ opts_done:
 	}
 
 	if(!linkname.has_value()) {
-		linkname = WlnGetFilename(WlnMakePathAbsolute(targets[0]));
+		linkname.emplace(WlnPathLeaf(WlnMakePathAbsolute(targets[0])));
 	}
 	std::wstring finalLinkname{linkname.value()};
 
-	auto linkFi{WlnGetAttributes(finalLinkname)};
-	if(linkFi && WlnIsDirectory(linkFi.value())) {
-		if(diropt == DirOptionTargetIsFile && WlnIsPhysicalDirectory(linkFi.value())) {
-			// only physical directories (unremoveable even with force) will fail -T
-			WlnAbortWithReason(L"destination `%ls' is a directory, but --no-target-directory was specified", finalLinkname.c_str());
-			return 1;
-		}
-	} else {
-		if(diropt == DirOptionTargetIsDir) {
-			WlnAbortWithReason(L"destination `%ls' is not a directory", finalLinkname.c_str());
-			return 1;
-		}
-		// missing file/file existing is okay here; force is processed later
-	}
+	auto linkFi{WlnCheckDestination(diropt, finalLinkname)};
 
-	for(const auto& target : targets) {
-		WlnCreateLink(linktyp, diropt, target, finalLinkname, force, relative, verbose, linkFi);
-	}
+	// Every link goes into the same directory, so it's opened just once.
+	WlnFsDirectory linkdir;
+	auto dir{WlnOpenLinkDirectory(diropt, finalLinkname, linkFi, linkdir)};
 
-	return 0;
+	RunPlan plan;
+	WlnPlanLinks(plan, targets.size(), jobs, [&](size_t i, std::string* result, LinkPlan& link) {
+		WlnPlanLinkWithResult(result, targets[i], finalLinkname, dir, linkopts, link);
+	});
+	WlnCarryOutPlan(plan, linkopts, jobs);
+
+	return WlnFinishRun(WlnReportFailures(linkopts.verify));
 }
 
-static void WlnCreateSymbolicLink(std::wstring target, const std::wstring& link, bool force, bool relative) {
-	auto targetFi{WlnGetAttributes(target)};
-	auto isDir = WlnIsDirectory(targetFi);
-	if(relative) {
-		std::wstring tabs = WlnMakePathAbsolute(target);
-		std::wstring lbase = WlnMakePathAbsoluteAsDirectory(link);
-		target = WlnMakePathRelative(tabs, lbase, isDir);
-	}
+// WlnSymbolicLinkContents returns the text a symbolic link at link (absolute)
+// pointing to target should hold.
+static std::wstring WlnSymbolicLinkContents(const std::wstring& target, const std::wstring& link, bool relative) {
+	if(!relative) return target;
 
-	int flags = SYMBOLIC_LINK_FLAG_ALLOW_UNPRIVILEGED_CREATE;
-	if(isDir) {
-		flags |= SYMBOLIC_LINK_FLAG_DIRECTORY;
-	}
+	auto tabs{WlnMakePathAbsolute(target)};
+	auto lbase{WlnMakePathAbsoluteAsDirectory(link)};
+	return WlnMakePathRelative(tabs, lbase);
+}
+
+enum class LinkMatch {
+	Identical,
+	WrongType, // not the kind of link we'd make
+	WrongTarget,
+};
 
-	if(force) {
-		// might as well try both.
-		RemoveDirectoryW(link.c_str());
-		DeleteFileW(link.c_str());
+// WlnMatchLink compares the existing link (described by destFi) with what we'd
+// replace it with. For WrongTarget, actual is where it points now (if it's
+// a link we can read).
+static LinkMatch WlnMatchLink(const std::wstring& target, const std::wstring& link, const WlnFsDirectory* dir, const std::wstring& name, const LinkOptions& options, const WlnFileInfo& destFi, std::wstring& actual) {
+	if(options.type == LinkTypeHard) {
+		return WlnIsSameFile(WlnGetFileID(target), destFi.id) ? LinkMatch::Identical : LinkMatch::WrongTarget;
 	}
 
-	if(!CreateSymbolicLinkW(link.c_str(), target.c_str(), flags)) {
-		WlnAbortWithWin32Error(GetLastError(), nullptr);
+	auto expectedTag = options.type == LinkTypeSymbolic ? WlnReparseTagSymlink : WlnReparseTagMountPoint;
+#ifndef _WIN32
+	expectedTag = WlnReparseTagSymlink; // junctions are symbolic links here
+#endif
+	if(destFi.reparseTag != expectedTag) return LinkMatch::WrongType;
+
+	if(WlnFsReadLink(dir, name, actual) != 0) return LinkMatch::WrongType;
+
+	if(options.type == LinkTypeSymbolic) {
+		// a directory symlink to a file (or vice versa) is broken on Windows, so it has to match too
+		if(WlnIsDirectory(destFi) != WlnIsDirectory(WlnGetFileInfo(target))) return LinkMatch::WrongType;
+		return actual == WlnSymbolicLinkContents(target, link, options.relative) ? LinkMatch::Identical : LinkMatch::WrongTarget;
 	}
+	return actual == WlnMakePathAbsolute(target) ? LinkMatch::Identical : LinkMatch::WrongTarget;
 }
 
-static void WlnCreateJunction(const std::wstring& target, const std::wstring& link, bool force) {
-	auto targetFi{WlnGetAttributes(target)};
-	if(!WlnIsPhysicalDirectory(targetFi)) {
-		WlnAbortWithReason(L"`%ls' is not a physical directory", target.c_str());
-	}
+// WlnIsLinkIdentical returns whether the existing link (described by destFi)
+// is already exactly what we'd replace it with.
+static bool WlnIsLinkIdentical(const std::wstring& target, const std::wstring& link, const WlnFsDirectory* dir, const std::wstring& name, const LinkOptions& options, const WlnFileInfo& destFi) {
+	std::wstring actual;
+	return WlnMatchLink(target, link, dir, name, options, destFi, actual) == LinkMatch::Identical;
+}
 
-	std::wstring tabs = WlnMakePathAbsolute(target);
-	if(tabs.compare(0, 4, L"\\\\?\\") == 0) {
-		tabs[1] = L'?'; // Replace "\\?\" with "\??\"
+// WlnVerifyLink aborts, explaining why, unless the link at link (name in dir)
+// is exactly what we'd create.
+static void WlnVerifyLink(const std::wstring& target, const std::wstring& link, const WlnFsDirectory* dir, const std::wstring& name, const LinkOptions& options, const std::optional<WlnFileInfo>& destFi) {
+	if(!destFi) {
+		WlnAbortWithReason(L"`%ls': missing", link.c_str());
 	}
 
-	if(tabs.compare(0, 4, L"\\??\\") != 0) {
-		tabs = L"\\??\\" + tabs;
+	std::wstring actual;
+	switch(WlnMatchLink(target, link, dir, name, options, destFi.value(), actual)) {
+	case LinkMatch::Identical:
+		break;
+	case LinkMatch::WrongType:
+		WlnAbortWithReason(L"`%ls' is not a %ls", link.c_str(), options.type == LinkTypeJunction ? L"junction" : WlnIsDirectory(WlnGetFileInfo(target)) ? L"directory symbolic link" : L"symbolic link");
+	case LinkMatch::WrongTarget:
+		if(options.type == LinkTypeHard) {
+			WlnAbortWithReason(L"`%ls' is not the same file as `%ls'", link.c_str(), target.c_str());
+		}
+		WlnAbortWithReason(L"`%ls' points to `%ls', not `%ls'", link.c_str(), actual.c_str(), target.c_str());
 	}
 
-	if(force) {
-		RemoveDirectoryW(link.c_str());
+	if(options.verbose) {
+		WlnPrintDiagnostic(L"`%ls' -> `%ls' (ok)\r\n", link.c_str(), target.c_str());
 	}
+}
 
-	if(!CreateDirectoryW(link.c_str(), nullptr)) {
-		WlnAbortWithWin32Error(GetLastError(), L"Failed to create junction `%ls'.", link.c_str());
-	}
+// WlnRemoveLink removes whatever link or file is at name; might as well try both.
+static void WlnRemoveLink(const WlnFsDirectory* dir, const std::wstring& name) {
+	WlnStatTimer timer{WlnStatPhase::RemoveExisting};
+	WlnFsRemoveDirectory(dir, name);
+	WlnFsDeleteFile(dir, name);
+}
 
-	HANDLE hFile = INVALID_HANDLE_VALUE;
-	if(INVALID_HANDLE_VALUE == (hFile = CreateFileW(link.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_FLAG_OPEN_REPARSE_POINT | FILE_FLAG_BACKUP_SEMANTICS, nullptr))) {
-		WlnAbortWithWin32Error(GetLastError(), L"Failed to open junction `%ls'.", link.c_str());
-	}
+// WlnTemporarySibling returns a name next to name (a leaf, or an absolute path)
+// for a link that will be renamed over it.
+static std::wstring WlnTemporarySibling(const std::wstring& name) {
+	static std::atomic<unsigned> counter{0};
+	wchar_t suffix[64];
+	swprintf(suffix, std::extent<decltype(suffix)>::value, L".winln-%u-%u", WlnFsGetProcessId(), counter++);
 
-	size_t reparseLength = sizeof(REPARSE_MOUNT_POINT_BUFFER) + (tabs.length() * sizeof(wchar_t)) + (2 * sizeof(wchar_t));
-	REPARSE_MOUNT_POINT_BUFFER* reparse = static_cast<REPARSE_MOUNT_POINT_BUFFER*>(calloc(1, reparseLength));
-	reparse->Header.ReparseTag = IO_REPARSE_TAG_MOUNT_POINT;
-	reparse->Header.ReparseDataLength = static_cast<uint16_t>(reparseLength - sizeof(REPARSE_POINT_HEADER));
-	reparse->SubstituteNameLength = static_cast<uint16_t>(tabs.length() * sizeof(wchar_t));
-	reparse->PrintNameOffset = static_cast<uint16_t>(reparse->SubstituteNameLength + sizeof(wchar_t));
-	reparse->PrintNameLength = 0;
+	size_t leaf = WlnPathFilenameOffset(name, WlnNativePathStyle);
+	std::wstring temp;
+	temp.reserve(name.size() + 1 + wcslen(suffix));
+	temp.append(name, 0, leaf);
+	temp += L'.';
+	temp.append(name, leaf, std::wstring::npos);
+	temp += suffix;
+	return temp;
+}
 
-	std::copy(tabs.begin(), tabs.end(), static_cast<wchar_t*>(reparse->PathBuffer));
+// WlnDisplaceLink moves whatever is at name out of the way of a new link, and
+// journals where it went, so that a rollback can put it back.
+static void WlnDisplaceLink(const WlnFsDirectory* dir, const std::wstring& name, const std::wstring& link) {
+	std::wstring backupName{WlnTemporarySibling(name)};
+	WlnJournalChange(WlnJournalOp::Displaced, link, dir ? dir->path() + backupName : backupName);
+	int err;
+	{
+		WlnStatTimer timer{WlnStatPhase::RemoveExisting};
+		err = WlnFsRename(dir, name, backupName);
+	}
+	if(err) {
+		WlnJournalCancel(link);
+		WlnAbortWithSystemError(err, L"Failed to move `%ls' aside.", link.c_str());
+	}
+}
 
-	if(!DeviceIoControl(hFile, FSCTL_SET_REPARSE_POINT, reparse, reparseLength, nullptr, 0, nullptr, nullptr)) {
-		CloseHandle(hFile);
-		WlnAbortWithWin32Error(GetLastError(), L"Failed to populate reparse point at `%ls'.", link.c_str());
+// WlnReplaceLink renames the link just created at tempName over name.
+static void WlnReplaceLink(const WlnFsDirectory* dir, const std::wstring& tempName, const std::wstring& name, const std::wstring& link, const WlnFileInfo& destFi) {
+	WlnStatTimer timer{WlnStatPhase::ReplaceLink};
+	int err = WlnFsRename(dir, tempName, name);
+	if(err && WlnIsDirectory(destFi)) {
+		// Windows can't rename over a directory link; the best we can do is
+		// make the gap as short as a single rename.
+		WlnFsRemoveDirectory(dir, name);
+		err = WlnFsRename(dir, tempName, name);
+	}
+	if(err) {
+		WlnRemoveLink(dir, tempName);
+		WlnJournalCancel(link);
+		WlnAbortWithSystemError(err, L"Failed to replace `%ls'.", link.c_str());
 	}
-	CloseHandle(hFile);
 }
 
-static void WlnCreateLink(LinkType type, DirOption diropt, const std::wstring& target, std::wstring link, bool force, bool relative, bool verbose, const std::optional<WIN32_FILE_ATTRIBUTE_DATA>& linkFileInfo) {
-	if(linkFileInfo && diropt != DirOptionTargetIsFile && WlnIsDirectory(linkFileInfo.value())) {
-		link += L"\\" + WlnGetFilename(WlnMakePathAbsolute(target));
+// WlnPlanLink plans the link from linkname to target (or, with dir (the opened
+// linkname), inside it, named after the target), and checks it against
+// whatever is there now, aborting if it can't be made. It doesn't change
+// anything. With result, it records the link's full path there. hints are
+// things it needn't look up.
+static void WlnPlanLink(const std::wstring& target, const std::wstring& linkname, const WlnFsDirectory* dir, const LinkOptions& options, LinkPlan& plan, WlnLinkResult* result, unsigned hints) {
+	pathArena.reset();
+
+	plan.target = target;
+	plan.dir = dir;
+	if(dir) {
+		plan.name.assign(WlnPathLeaf(WlnMakePathAbsolute(target)));
+		plan.link.reserve(dir->path().size() + plan.name.size());
+		plan.link.assign(dir->path());
+		plan.link += plan.name;
+	} else {
+		plan.link.assign(WlnMakePathAbsolute(linkname));
+		plan.name = plan.link;
+	}
+	auto& link = plan.link;
+	if(result) {
+		result->link = link;
+	}
+
+	if(!(hints & PlanHintNewDestination)) {
+		plan.destFi = WlnGetFileInfo(link, dir, plan.name);
+	}
+	auto& destFi = plan.destFi;
+	if(options.verify) {
+		WlnVerifyLink(target, link, dir, plan.name, options, destFi);
+		plan.outcome = WlnLinkOutcome::Verified;
+		return;
 	}
-	link = WlnMakePathAbsolute(link);
 
-	auto destFi{WlnGetAttributes(link)};
 	if(destFi) {
-		if(WlnIsSameFile(WlnGetFileID(target), WlnGetFileID(link))) {
-			WlnAbortWithReason(L"`%ls' and `%ls' are the same file", target.c_str(), link.c_str());
+		if(options.skipIdentical && WlnIsLinkIdentical(target, link, dir, plan.name, options, destFi.value())) {
+			if(options.verbose) {
+				WlnPrintDiagnostic(L"`%ls' -> `%ls' (unchanged)\r\n", link.c_str(), target.c_str());
+			}
+			plan.outcome = WlnLinkOutcome::Unchanged;
 			return;
 		}
 
+		if(WlnIsSameFile(WlnGetFileID(target), destFi->id)) {
+			WlnAbortWithReason(L"`%ls' and `%ls' are the same file", target.c_str(), link.c_str());
+		}
+
 		if(WlnIsPhysicalDirectory(destFi.value())) {
 			WlnAbortWithReason(L"cannot overwrite directory `%ls'", link.c_str());
-			return;
 		}
 
-		if(!force) {
+		if(!options.force) {
 			WlnAbortWithReason(L"`%ls': destination exists", link.c_str());
 		}
 	}
 
-	if(verbose) {
-		fwprintf(stderr, L"`%ls' -> `%ls'\r\n", link.c_str(), target.c_str());
-	}
-
-	switch(type) {
-	case LinkTypeHard:
-		if(!CreateHardLinkW(link.c_str(), target.c_str(), nullptr)) {
-			WlnAbortWithWin32Error(GetLastError(), nullptr);
+	switch(options.type) {
+	case LinkTypeHard: {
+		if(hints & PlanHintTargetIsFile) {
+			plan.contents = target;
+			break;
 		}
+		auto targetFi{WlnGetFileInfo(target)};
+		if(!targetFi) {
+			// Fail it the way making it would have.
+			WlnFileInfo info;
+			int err = WlnFsQueryFileInfo(nullptr, std::wstring{WlnMakePathAbsolute(target)}, info);
+			WlnAbortWithSystemError(err, L"Failed to create hard link `%ls'.", link.c_str());
+		}
+		if(WlnIsDirectory(targetFi)) {
+			WlnAbortWithReason(L"`%ls': hard link not allowed for directory", target.c_str());
+		}
+		plan.contents = target;
 		break;
+	}
 	case LinkTypeSymbolic:
-		WlnCreateSymbolicLink(target, link, force, relative);
+		plan.targetIsDirectory = WlnIsDirectory(WlnGetFileInfo(target));
+		plan.contents = WlnSymbolicLinkContents(target, link, options.relative);
 		break;
 	case LinkTypeJunction:
-		WlnCreateJunction(target, link, force);
+		if(!WlnIsPhysicalDirectory(WlnGetFileInfo(target))) {
+			WlnAbortWithReason(L"`%ls' is not a physical directory", target.c_str());
+		}
+		plan.contents = WlnMakePathAbsolute(target);
 		break;
 	}
-}
\ No newline at end of file
+	plan.outcome = WlnLinkOutcome::Created;
+}
+
+// WlnExecuteLink makes the link plan describes.
+static WlnLinkOutcome WlnExecuteLink(const LinkPlan& plan, const LinkOptions& options) {
+	auto& link = plan.link;
+	auto& name = plan.name;
+	auto dir = plan.dir;
+	if(options.verbose) {
+		WlnPrintDiagnostic(L"`%ls' -> `%ls'\r\n", link.c_str(), plan.target.c_str());
+	}
+
+	// With --atomic, an existing destination is replaced by creating the link
+	// beside it and renaming it into place, so that it never goes missing.
+	// Otherwise (with -f, or we'd have stopped already) it's removed first, or
+	// in a transaction, moved aside until the end.
+	std::wstring tempName;
+	if(plan.destFi && options.atomic) {
+		tempName = WlnTemporarySibling(name);
+	} else if(plan.destFi && journal) {
+		WlnDisplaceLink(dir, name, link);
+	} else if(plan.destFi) {
+		WlnRemoveLink(dir, name);
+	}
+	const std::wstring& createName = tempName.empty() ? name : tempName;
+
+	WlnJournalChange(WlnJournalOp::CreatedLink, link);
+	{
+		WlnStatTimer timer{WlnStatPhase::CreateLink};
+		switch(options.type) {
+		case LinkTypeHard:
+			if(int err = WlnFsCreateHardLink(dir, createName, plan.contents)) {
+				WlnJournalCancel(link);
+				WlnAbortWithSystemError(err, L"Failed to create hard link `%ls'.", link.c_str());
+			}
+			break;
+		case LinkTypeSymbolic:
+			if(int err = WlnFsCreateSymbolicLink(dir, createName, plan.contents, plan.targetIsDirectory)) {
+				WlnJournalCancel(link);
+				WlnAbortWithSystemError(err, L"Failed to create symbolic link `%ls'.", link.c_str());
+			}
+			break;
+		case LinkTypeJunction:
+			if(int err = WlnFsCreateJunction(dir, createName, plan.contents)) {
+				WlnJournalCancel(link);
+				WlnAbortWithSystemError(err, L"Failed to create junction `%ls'.", link.c_str());
+			}
+			break;
+		}
+	}
+
+	if(!tempName.empty()) {
+		WlnReplaceLink(dir, tempName, name, link, plan.destFi.value());
+	}
+	fileInfoCache.invalidate(link);
+	return WlnLinkOutcome::Created;
+}
+
+int wmain(int argc, wchar_t** argv) {
+	int status = WlnMain(argc, argv);
+	WlnPrintStats();
+	return status;
+}
+
+#ifndef _WIN32
+// WlnHasResponseFiles returns whether any of argv is an @file argument.
+static bool WlnHasResponseFiles(int argc, char** argv) {
+	for(int i = 1; i < argc && strcmp(argv[i], "--") != 0; ++i) {
+		if(argv[i][0] == '@' && argv[i][1] != '\0') return true;
+	}
+	return false;
+}
+
+// POSIX has no wmain. The (UTF-8) arguments are parsed as they are, and only
+// the ones kept are widened; response files are read as wide arguments,
+// though, so a command line with any is widened whole and goes to wmain.
+int main(int argc, char** argv) {
+	setlocale(LC_ALL, "");
+
+	if(!WlnHasResponseFiles(argc, argv)) {
+		int status = WlnMain(argc, argv);
+		WlnPrintStats();
+		return status;
+	}
+
+	std::vector<std::wstring> args(argc);
+	std::vector<wchar_t*> wargv(argc + 1);
+	for(int i = 0; i < argc; ++i) {
+		if(!WlnUtf8ToWide(argv[i], strlen(argv[i]), args[i])) {
+			WlnAbortWithReason(L"argument %d is not valid UTF-8", i);
+		}
+		wargv[i] = &args[i][0];
+	}
+	return wmain(argc, wargv.data());
+}
+#endif
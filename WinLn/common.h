@@ -1,6 +1,8 @@
 #pragma once
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#endif
 
-#define LONG_MAX_PATH 32768
\ No newline at end of file
+#define LONG_MAX_PATH 32768
@@ -0,0 +1,166 @@
+#include "dedupe.h"
+#include "error.h"
+#include "fs.h"
+#include "hash.h"
+#include "threadpool.h"
+#include "walk.h"
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+// Mapped files are fed to the hasher this much at a time.
+static constexpr size_t WlnDedupeChunkSize = 1024 * 1024;
+
+namespace {
+struct candidate {
+	std::wstring path;
+	size_t found; // its place in the walk
+	WlnFileID id;
+	uint64_t size;
+	uint64_t hash;
+	int error; // from reading it
+};
+}
+
+static int WlnCompareFileID(const WlnFileID& left, const WlnFileID& right) {
+	if(left.volume != right.volume) return left.volume < right.volume ? -1 : 1;
+	return memcmp(&left.id[0], &right.id[0], sizeof(left.id));
+}
+
+// WlnHashFile hashes the whole file at path.
+static int WlnHashFile(const std::wstring& path, uint64_t& hash) {
+	WlnFsMappedFile file;
+	if(int err = file.open(nullptr, path)) return err;
+
+	WlnHasher hasher;
+	for(size_t offset = 0; offset < file.size(); offset += WlnDedupeChunkSize) {
+		hasher.update(file.data() + offset, std::min(WlnDedupeChunkSize, file.size() - offset));
+	}
+	hash = hasher.finish();
+	return 0;
+}
+
+// WlnSameContents compares two files byte for byte.
+static int WlnSameContents(candidate& left, candidate& right, bool& same) {
+	WlnFsMappedFile l, r;
+	if(int err = l.open(nullptr, left.path)) {
+		left.error = err;
+		return err;
+	}
+	if(int err = r.open(nullptr, right.path)) {
+		right.error = err;
+		return err;
+	}
+	same = l.size() == r.size() && memcmp(l.data(), r.data(), l.size()) == 0;
+	return 0;
+}
+
+// WlnCheckReadErrors aborts if any of the files in indices couldn't be read.
+static void WlnCheckReadErrors(const std::vector<candidate>& files, const std::vector<size_t>& indices) {
+	for(size_t i : indices) {
+		if(files[i].error) {
+			WlnAbortWithSystemError(files[i].error, L"Failed to read `%ls'.", files[i].path.c_str());
+		}
+	}
+}
+
+std::vector<WlnDuplicate> WlnFindDuplicates(const std::wstring& root, unsigned jobs) {
+	std::vector<candidate> files;
+	WlnWalkTree(root, WlnFsEntryID | WlnFsEntrySize, [&](const WlnWalkEntry& entry) {
+		if(entry.info.attributes & (WlnFileAttributeDirectory | WlnFileAttributeReparsePoint)) return;
+		if(entry.info.size == 0) return;
+		files.push_back(candidate{entry.path, files.size(), entry.info.id, entry.info.size, 0, 0});
+	});
+
+	// Only files of the same size on the same volume can be linked together.
+	// Names of one file sort next to each other, in the order they were found.
+	std::stable_sort(files.begin(), files.end(), [](const candidate& left, const candidate& right) {
+		if(left.id.volume != right.id.volume) return left.id.volume < right.id.volume;
+		if(left.size != right.size) return left.size < right.size;
+		return WlnCompareFileID(left.id, right.id) < 0;
+	});
+
+	// Hash one name of every file that shares its size with another file.
+	std::vector<size_t> toHash;
+	for(size_t start = 0, end; start < files.size(); start = end) {
+		size_t distinct = 1;
+		for(end = start + 1; end < files.size() && files[end].id.volume == files[start].id.volume && files[end].size == files[start].size; ++end) {
+			if(WlnCompareFileID(files[end].id, files[end - 1].id) != 0) ++distinct;
+		}
+		if(distinct < 2) continue;
+		for(size_t i = start; i < end; ++i) {
+			if(i == start || WlnCompareFileID(files[i].id, files[i - 1].id) != 0) {
+				toHash.push_back(i);
+			}
+		}
+	}
+
+	WlnParallelFor(toHash.size(), jobs, [&](size_t i) {
+		auto& file = files[toHash[i]];
+		file.error = WlnHashFile(file.path, file.hash);
+	});
+	WlnCheckReadErrors(files, toHash);
+
+	// Within each group of files with equal hashes, every file is linked to
+	// the first one (in walk order) it turns out to be identical to.
+	std::vector<size_t> byHash{toHash};
+	std::sort(byHash.begin(), byHash.end(), [&](size_t left, size_t right) {
+		auto& l = files[left];
+		auto& r = files[right];
+		return std::tie(l.id.volume, l.size, l.hash, l.found) < std::tie(r.id.volume, r.size, r.hash, r.found);
+	});
+
+	std::vector<std::pair<size_t, size_t>> groups;
+	for(size_t start = 0, end; start < byHash.size(); start = end) {
+		auto& first = files[byHash[start]];
+		for(end = start + 1; end < byHash.size(); ++end) {
+			auto& f = files[byHash[end]];
+			if(f.id.volume != first.id.volume || f.size != first.size || f.hash != first.hash) break;
+		}
+		if(end - start > 1) {
+			groups.emplace_back(start, end);
+		}
+	}
+
+	// originalOf[i] is the file (index into files) that files[byHash[i]] duplicates.
+	std::vector<size_t> originalOf(byHash.size(), SIZE_MAX);
+	WlnParallelFor(groups.size(), jobs, [&](size_t g) {
+		std::vector<size_t> originals;
+		for(size_t i = groups[g].first; i < groups[g].second; ++i) {
+			for(size_t o : originals) {
+				bool same = false;
+				if(WlnSameContents(files[o], files[byHash[i]], same)) return;
+				if(same) {
+					originalOf[i] = o;
+					break;
+				}
+			}
+			if(originalOf[i] == SIZE_MAX) {
+				originals.push_back(byHash[i]);
+			}
+		}
+	});
+	WlnCheckReadErrors(files, toHash);
+
+	// Every name of a duplicate file has to go, or its data stays around.
+	std::vector<std::pair<size_t, WlnDuplicate>> found;
+	for(size_t i = 0; i < byHash.size(); ++i) {
+		if(originalOf[i] == SIZE_MAX) continue;
+		auto& original = files[originalOf[i]];
+		for(size_t n = byHash[i]; n < files.size() && WlnCompareFileID(files[n].id, files[byHash[i]].id) == 0; ++n) {
+			found.emplace_back(files[n].found, WlnDuplicate{original.path, files[n].path});
+		}
+	}
+
+	// Report them in the order the walk found them.
+	std::sort(found.begin(), found.end(), [](const auto& left, const auto& right) {
+		return left.first < right.first;
+	});
+	std::vector<WlnDuplicate> duplicates;
+	duplicates.reserve(found.size());
+	for(auto& f : found) {
+		duplicates.push_back(std::move(f.second));
+	}
+	return duplicates;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// WlnDuplicate is a file with the same contents as original (an earlier file,
+// on the same volume) that could be a hard link to it instead.
+struct WlnDuplicate {
+	std::wstring original;
+	std::wstring duplicate;
+};
+
+// WlnFindDuplicates walks root (an absolute, normalized directory) and returns
+// every file that duplicates another. Only files of the same size are hashed,
+// on up to jobs threads, and files whose hashes match are compared in full
+// before they count. Files that are already hard links to each other aren't
+// duplicates, and neither are empty files.
+std::vector<WlnDuplicate> WlnFindDuplicates(const std::wstring& root, unsigned jobs);
@@ -1,64 +1,231 @@
 #include "common.h"
 #include "error.h"
+#include "utf8.h"
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <cstdarg>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <type_traits>
+
+#ifndef _WIN32
+#include <errno.h>
+#endif
+
+static thread_local std::wstring* t_capture = nullptr;
+
+WlnOutputCapture::WlnOutputCapture(std::wstring& buffer) : _previous(t_capture) {
+	t_capture = &buffer;
+}
+
+WlnOutputCapture::~WlnOutputCapture() {
+	t_capture = _previous;
+}
+
+// WlnVFormat appends fmt, formatted, to out.
+static void WlnVFormat(std::wstring& out, const wchar_t* fmt, va_list ap) {
+	wchar_t stackbuf[512];
+	va_list aq;
+	va_copy(aq, ap);
+	int len = vswprintf(stackbuf, std::extent<decltype(stackbuf)>::value, fmt, aq);
+	va_end(aq);
+	if(len >= 0) {
+		out.append(stackbuf, len);
+		return;
+	}
+
+	// vswprintf doesn't report the length it needed; grow until it fits.
+	std::wstring buf(2 * std::extent<decltype(stackbuf)>::value, L'\0');
+	for(;;) {
+		va_copy(aq, ap);
+		len = vswprintf(&buf[0], buf.size(), fmt, aq);
+		va_end(aq);
+		if(len >= 0 || buf.size() > LONG_MAX_PATH * 4) break;
+		buf.resize(buf.size() * 2);
+	}
+	if(len > 0) {
+		out.append(buf, 0, len);
+	}
+}
+
+// Workers print too, so writes to stderr (and atLineStart, whether the last
+// one ended its line) are serialized by stderrLock.
+static std::mutex stderrLock;
+static bool atLineStart = true;
+
+// WlnVPrint is the only place that writes to stderr, so that a capture can
+// intercept all of it.
+static void WlnVPrint(const wchar_t* fmt, va_list ap) {
+	if(t_capture) {
+		WlnVFormat(*t_capture, fmt, ap);
+		return;
+	}
+
+	static thread_local std::wstring text;
+	text.clear();
+	WlnVFormat(text, fmt, ap);
+	std::lock_guard<std::mutex> guard{stderrLock};
+	fputws(text.c_str(), stderr);
+	if(!text.empty()) {
+		atLineStart = text.back() == L'\n';
+	}
+}
+
+static void WlnPrint(const wchar_t* fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	WlnVPrint(fmt, ap);
+	va_end(ap);
+}
+
+// WlnCaptureMark returns where the next captured message will start.
+static size_t WlnCaptureMark() {
+	return t_capture ? t_capture->size() : 0;
+}
+
+static std::atomic<void (*)()> abortHandler{nullptr};
+
+void WlnSetAbortHandler(void (*handler)()) {
+	abortHandler = handler;
+}
+
+[[noreturn]] void WlnExitWithFailure() {
+	// Abort messages don't end their lines; this does.
+	bool endLine;
+	{
+		std::lock_guard<std::mutex> guard{stderrLock};
+		endLine = !atLineStart;
+	}
+	if(endLine) {
+		WlnPrint(L"\r\n");
+	}
+	if(auto handler = abortHandler.exchange(nullptr)) {
+		handler();
+	}
+	exit(1);
+}
+
+// WlnExit ends the program, or throws if output is being captured. mark is
+// where the abort message starts in the capture.
+[[noreturn]] static void WlnExit(int err, size_t mark) {
+	if(t_capture) {
+		throw WlnAbortException{err, t_capture->substr(mark)};
+	}
+	WlnExitWithFailure();
+}
+
+void WlnPrintDiagnostic(const wchar_t* fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	WlnVPrint(fmt, ap);
+	va_end(ap);
+}
 
 const std::wstring& WlnGetProgName() {
 	static std::wstring fn = []()->auto {
+#ifdef _WIN32
 		wchar_t fn[LONG_MAX_PATH];
 		if(!GetModuleFileNameW(nullptr, fn, std::extent<decltype(fn)>::value)) {
-			WlnAbortWithWin32Error(GetLastError(), L"Failed to determine launch path.");
+			WlnAbortWithSystemError(GetLastError(), L"Failed to determine launch path.");
 		}
 		return std::wstring{wcsrchr(fn, L'\\') + 1};
+#else
+		std::wstring fn;
+#ifdef __GLIBC__
+		WlnUtf8ToWide(program_invocation_short_name, strlen(program_invocation_short_name), fn);
+#else
+		WlnUtf8ToWide(getprogname(), strlen(getprogname()), fn);
+#endif
+		return fn;
+#endif
 	}();
 	return fn;
 }
 
-__declspec(noreturn) void WlnAbortWithArgumentError(const wchar_t* fmt, ...) {
-	fwprintf(stderr, L"%ls: ", WlnGetProgName().c_str());
+bool WlnIsProgName(const wchar_t* name) {
+	std::wstring prog{WlnGetProgName()};
+#ifdef _WIN32
+	auto dot = prog.rfind(L'.');
+	if(dot != std::wstring::npos && _wcsicmp(prog.c_str() + dot, L".exe") == 0) {
+		prog.resize(dot);
+	}
+	return _wcsicmp(prog.c_str(), name) == 0;
+#else
+	return prog == name;
+#endif
+}
+
+[[noreturn]] void WlnAbortWithArgumentError(const wchar_t* fmt, ...) {
+	WlnPrint(L"%ls: ", WlnGetProgName().c_str());
+	size_t mark = WlnCaptureMark();
 	va_list ap;
 	va_start(ap, fmt);
-	vfwprintf(stderr, fmt, ap);
+	WlnVPrint(fmt, ap);
 	va_end(ap);
-	fwprintf(stderr, L"\r\nTry `%ls --help' for more information.\r\n", WlnGetProgName().c_str());
-	exit(1);
+	WlnPrint(L"\r\nTry `%ls --help' for more information.\r\n", WlnGetProgName().c_str());
+	WlnExit(0, mark);
 }
 
+#ifdef _WIN32
 template <typename T>
 static void _heapFree(T* ptr) {
 	HeapFree(GetProcessHeap(), 0, ptr);
 }
+#endif
 
-__declspec(noreturn) void WlnAbortWithReason(const wchar_t* fmt, ...) {
-	fwprintf(stderr, L"%ls: ", WlnGetProgName().c_str());
+[[noreturn]] void WlnAbortWithReason(const wchar_t* fmt, ...) {
+	WlnPrint(L"%ls: ", WlnGetProgName().c_str());
+	size_t mark = WlnCaptureMark();
 
 	va_list ap;
 	va_start(ap, fmt);
-	vfwprintf(stderr, fmt, ap);
+	WlnVPrint(fmt, ap);
 	va_end(ap);
 
-	exit(1);
+	WlnExit(0, mark);
 }
 
-__declspec(noreturn) void WlnAbortWithWin32Error(int err, const wchar_t* fmt, ...) {
+[[noreturn]] void WlnAbortWithSystemError(int err, const wchar_t* fmt, ...) {
+#ifdef _WIN32
 	std::unique_ptr<wchar_t, void(*)(wchar_t*)> buf(nullptr, _heapFree<wchar_t>);
 	if(err) {
 		wchar_t* b = nullptr;
 		FormatMessageW(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM, nullptr, err, 0, (LPWSTR)&b, 1024, nullptr);
 		buf.reset(b);
 	}
+#else
+	std::wstring buf;
+	if(err) {
+		const char* msg = strerror(err);
+		WlnUtf8ToWide(msg, strlen(msg), buf);
+	}
+#endif
+	size_t mark = WlnCaptureMark();
 	if(fmt) {
-		fwprintf(stderr, L"%ls: ", WlnGetProgName().c_str());
+		WlnPrint(L"%ls: ", WlnGetProgName().c_str());
+		mark = WlnCaptureMark();
 		va_list ap;
 		va_start(ap, fmt);
-		vfwprintf(stderr, fmt, ap);
+		WlnVPrint(fmt, ap);
 		va_end(ap);
+		if(err) {
+			WlnPrint(L" ");
+		}
 	}
+#ifdef _WIN32
 	if(buf) {
-		fwprintf(stderr, L"Error 0x%8.08X: %ls", err, buf.get()); // FormatMessageW emits \r\n
+		WlnPrint(L"Error 0x%8.08X: %ls", err, buf.get()); // FormatMessageW emits \r\n
 	}
+#else
+	if(err) {
+		WlnPrint(L"Error %d: %ls\n", err, buf.c_str());
+	}
+#endif
 
-	exit(1);
+	WlnExit(err, mark);
 }
@@ -2,7 +2,43 @@
 
 #include <string>
 
-__declspec(noreturn) void WlnAbortWithReason(const wchar_t* fmt, ...);
-__declspec(noreturn) void WlnAbortWithWin32Error(int err, const wchar_t* fmt, ...);
-__declspec(noreturn) void WlnAbortWithArgumentError(const wchar_t* fmt, ...);
-const std::wstring& WlnGetProgName();
\ No newline at end of file
+// WlnAbortWithSystemError takes a GetLastError() code on Windows and an errno value elsewhere.
+[[noreturn]] void WlnAbortWithReason(const wchar_t* fmt, ...);
+[[noreturn]] void WlnAbortWithSystemError(int err, const wchar_t* fmt, ...);
+[[noreturn]] void WlnAbortWithArgumentError(const wchar_t* fmt, ...);
+const std::wstring& WlnGetProgName();
+// WlnIsProgName returns whether we were started as name (ignoring .exe, and case on Windows).
+bool WlnIsProgName(const wchar_t* name);
+
+// WlnSetAbortHandler has every abort that ends the program call handler
+// first (once; it's removed before it runs). Aborts thrown to a
+// WlnOutputCapture don't call it.
+void WlnSetAbortHandler(void (*handler)());
+
+// WlnExitWithFailure ends the program with status 1, like an abort does.
+[[noreturn]] void WlnExitWithFailure();
+
+// WlnPrintDiagnostic writes informational output (like --verbose) to stderr.
+void WlnPrintDiagnostic(const wchar_t* fmt, ...);
+
+// WlnAbortException is thrown by the WlnAbort* functions instead of exiting
+// while a WlnOutputCapture is active on the calling thread. It describes the
+// failure, so that callers that can carry on (--keep-going) can report it later.
+struct WlnAbortException {
+	int error; // the system error passed to WlnAbortWithSystemError, or 0
+	std::wstring message; // what was printed, without the program name
+};
+
+// WlnOutputCapture redirects everything the calling thread would print to
+// stderr (diagnostics and abort messages) into buffer, for as long as it lives.
+class WlnOutputCapture {
+private:
+	std::wstring* _previous;
+
+public:
+	explicit WlnOutputCapture(std::wstring& buffer);
+	~WlnOutputCapture();
+
+	WlnOutputCapture(const WlnOutputCapture&) = delete;
+	WlnOutputCapture& operator=(const WlnOutputCapture&) = delete;
+};
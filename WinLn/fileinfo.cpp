@@ -0,0 +1,55 @@
+#include "fileinfo.h"
+
+#include <functional>
+
+// Lookups need a std::wstring key; reusing one per thread keeps them from allocating.
+static thread_local std::wstring t_key;
+
+WlnFileInfoCache::shard& WlnFileInfoCache::_shardFor(std::wstring_view path) {
+	return _shards[std::hash<std::wstring_view>{}(path) % ShardCount];
+}
+
+int WlnFileInfoCache::query(std::wstring_view absolutePath, std::optional<WlnFileInfo>& info) {
+	return _query(absolutePath, nullptr, nullptr, info);
+}
+
+int WlnFileInfoCache::query(std::wstring_view absolutePath, const WlnFsDirectory& dir, const std::wstring& name, std::optional<WlnFileInfo>& info) {
+	return _query(absolutePath, &dir, &name, info);
+}
+
+int WlnFileInfoCache::_query(std::wstring_view absolutePath, const WlnFsDirectory* dir, const std::wstring* name, std::optional<WlnFileInfo>& info) {
+	auto& s = _shardFor(absolutePath);
+	t_key.assign(absolutePath);
+	{
+		std::lock_guard<std::mutex> guard{s.lock};
+		auto it = s.entries.find(t_key);
+		if(it != s.entries.end()) {
+			info = it->second;
+			return 0;
+		}
+	}
+
+	// Query outside the lock; racing threads may both ask, but they'll agree.
+	WlnFileInfo fi{};
+	int err = WlnFsQueryFileInfo(dir, dir ? *name : t_key, fi);
+	if(err && !WlnFsIsNotFound(err)) {
+		return err;
+	}
+
+	if(err) {
+		info.reset();
+	} else {
+		info = fi;
+	}
+
+	std::lock_guard<std::mutex> guard{s.lock};
+	s.entries.emplace(t_key, info);
+	return 0;
+}
+
+void WlnFileInfoCache::invalidate(std::wstring_view absolutePath) {
+	auto& s = _shardFor(absolutePath);
+	t_key.assign(absolutePath);
+	std::lock_guard<std::mutex> guard{s.lock};
+	s.entries.erase(t_key);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "fs.h"
+
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// WlnFileInfoCache remembers WlnFsQueryFileInfo results (including "doesn't
+// exist") by absolute path, so that every path is opened at most once per run.
+// Anything that changes what lives at a path must invalidate it.
+// It is safe to use from multiple threads.
+class WlnFileInfoCache {
+private:
+	static constexpr size_t ShardCount = 16;
+
+	struct shard {
+		std::mutex lock;
+		std::unordered_map<std::wstring, std::optional<WlnFileInfo>> entries;
+	};
+	shard _shards[ShardCount];
+
+	shard& _shardFor(std::wstring_view path);
+	int _query(std::wstring_view absolutePath, const WlnFsDirectory* dir, const std::wstring* name, std::optional<WlnFileInfo>& info);
+
+public:
+	// query fills info (leaving it empty if path doesn't exist) and returns 0,
+	// or returns the system error that prevented the query. Errors aren't cached.
+	int query(std::wstring_view absolutePath, std::optional<WlnFileInfo>& info);
+
+	// This query asks the filesystem for name in dir (which is absolutePath)
+	// on a miss, so it needn't walk the whole path again.
+	int query(std::wstring_view absolutePath, const WlnFsDirectory& dir, const std::wstring& name, std::optional<WlnFileInfo>& info);
+
+	// invalidate forgets absolutePath; the next query will go to the filesystem.
+	void invalidate(std::wstring_view absolutePath);
+};
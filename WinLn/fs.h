@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The filesystem backend. Every primitive the link engine needs from the OS
+// lives behind these functions; fs_win32.cpp and fs_posix.cpp each implement
+// them for one platform.
+//
+// Functions returning int return 0 on success, or a system error code on
+// failure: GetLastError() on Windows, errno elsewhere. Pass those to
+// WlnAbortWithSystemError.
+
+#ifdef _WIN32
+#define WLN_PATH_SEPARATOR L'\\'
+#else
+#define WLN_PATH_SEPARATOR L'/'
+#endif
+
+enum WlnFileAttribute : uint32_t {
+	WlnFileAttributeDirectory = 0x1,
+	WlnFileAttributeReparsePoint = 0x2, // symbolic link or junction
+};
+
+// Reparse tags share their values with the Windows IO_REPARSE_TAG_* constants.
+enum WlnReparseTag : uint32_t {
+	WlnReparseTagNone = 0,
+	WlnReparseTagMountPoint = 0xA0000003,
+	WlnReparseTagSymlink = 0xA000000C,
+};
+
+struct WlnFileID {
+	uint64_t volume;
+	uint8_t id[16];
+};
+
+struct WlnFileInfo {
+	uint32_t attributes; // WlnFileAttribute
+	uint32_t reparseTag; // WlnReparseTag, or another tag we don't know about
+	WlnFileID id;
+	uint64_t size; // in bytes; only meaningful for files
+};
+
+// WlnFsDirectory is a directory held open so that links can be created in it
+// by leaf name. On POSIX it's a descriptor for the *at() functions. Windows has
+// no documented way to name links relative to a handle, so there it keeps the
+// directory open (so it can't move away) and joins names onto its path.
+class WlnFsDirectory {
+private:
+	std::wstring _path;
+#ifdef _WIN32
+	void* _handle;
+#else
+	int _fd;
+#endif
+
+public:
+	WlnFsDirectory();
+	~WlnFsDirectory();
+
+	WlnFsDirectory(const WlnFsDirectory&) = delete;
+	WlnFsDirectory& operator=(const WlnFsDirectory&) = delete;
+
+	// open opens the directory at path, which must be absolute and normalized.
+	int open(std::wstring_view path);
+
+	// path returns the directory's path, ending in a separator.
+	const std::wstring& path() const {
+		return _path;
+	}
+
+#ifdef _WIN32
+	void* handle() const {
+		return _handle;
+	}
+#else
+	int fd() const {
+		return _fd;
+	}
+#endif
+};
+
+// WlnFsIsNotFound returns whether err means that the path doesn't exist.
+bool WlnFsIsNotFound(int err);
+
+uint32_t WlnFsGetProcessId();
+
+int WlnFsGetCurrentDirectory(std::wstring& cwd);
+// WlnFsGetDriveDirectory returns the current directory on another drive (for
+// paths like C:foo). It fails on platforms without drive letters.
+int WlnFsGetDriveDirectory(wchar_t drive, std::wstring& cwd);
+
+// The functions below name the file they work on with dir and name. If dir is
+// null, name is a path; otherwise it is a leaf name inside dir.
+
+// WlnFsQueryFileInfo opens the file (not following links) once and reads
+// everything in WlnFileInfo from it.
+int WlnFsQueryFileInfo(const WlnFsDirectory* dir, const std::wstring& name, WlnFileInfo& info);
+
+int WlnFsCreateHardLink(const WlnFsDirectory* dir, const std::wstring& link, const std::wstring& target);
+int WlnFsCreateSymbolicLink(const WlnFsDirectory* dir, const std::wstring& link, const std::wstring& target, bool isDir);
+// WlnFsCreateJunction expects an absolute target.
+int WlnFsCreateJunction(const WlnFsDirectory* dir, const std::wstring& link, const std::wstring& target);
+
+// WlnFsReadLink reads where a symbolic link or junction points, in the form
+// that was given to WlnFsCreateSymbolicLink or WlnFsCreateJunction.
+int WlnFsReadLink(const WlnFsDirectory* dir, const std::wstring& name, std::wstring& target);
+
+// WlnFsRename renames from to to (both names in dir), replacing any file or
+// file link at to in one step, so that to never goes missing. Windows can't
+// rename over a directory, not even a directory link or junction.
+int WlnFsRename(const WlnFsDirectory* dir, const std::wstring& from, const std::wstring& to);
+
+int WlnFsCreateDirectory(const WlnFsDirectory* dir, const std::wstring& name);
+
+// Which parts of a WlnFsDirectoryEntry's info the listing filled in.
+enum WlnFsEntryField : uint32_t {
+	WlnFsEntryAttributes = 0x1, // attributes and reparseTag
+	WlnFsEntryID = 0x2,
+	WlnFsEntrySize = 0x4,
+	WlnFsEntryAll = WlnFsEntryAttributes | WlnFsEntryID | WlnFsEntrySize,
+};
+
+struct WlnFsDirectoryEntry {
+	std::wstring name;
+	WlnFileInfo info;
+	uint32_t known; // WlnFsEntryField; query the file for anything else
+};
+
+// WlnFsDirectoryReader reads a directory's entries many at a time, along with
+// whatever the OS returns about each one in the same call, into a buffer
+// that's reused from one directory to the next. On Windows that's everything
+// in WlnFileInfo; Linux only has the type (and nothing for links, since it
+// can't say whether they point to directories).
+class WlnFsDirectoryReader {
+private:
+	std::vector<uint8_t> _buffer;
+	size_t _offset; // of the next entry in _buffer
+	size_t _length; // of the entries in _buffer
+	int _error;
+#ifdef _WIN32
+	void* _handle;
+	uint64_t _volume;
+	int _class; // the FILE_INFO_BY_HANDLE_CLASS we're reading
+	bool _restart;
+#else
+	int _fd;
+	void* _stream; // a DIR*, where there's no getdents64
+#endif
+
+	bool _fill();
+
+public:
+	WlnFsDirectoryReader();
+	~WlnFsDirectoryReader();
+
+	WlnFsDirectoryReader(const WlnFsDirectoryReader&) = delete;
+	WlnFsDirectoryReader& operator=(const WlnFsDirectoryReader&) = delete;
+
+	// open starts reading dir from the beginning. dir must stay open (and
+	// not be read by anyone else) until the last call to next.
+	int open(const WlnFsDirectory& dir);
+
+	// next fills entry with the next entry (never . or ..) and returns true,
+	// or returns false at the end or on failure; see error.
+	bool next(WlnFsDirectoryEntry& entry);
+
+	// error returns why next returned false, or 0 at the end of the directory.
+	int error() const {
+		return _error;
+	}
+};
+
+// WlnFsMappedFile is a whole file mapped read-only into memory.
+class WlnFsMappedFile {
+private:
+	const uint8_t* _data;
+	size_t _size;
+
+public:
+	WlnFsMappedFile();
+	~WlnFsMappedFile();
+
+	WlnFsMappedFile(const WlnFsMappedFile&) = delete;
+	WlnFsMappedFile& operator=(const WlnFsMappedFile&) = delete;
+
+	// open maps the file (name in dir), which is going to be read front to back.
+	int open(const WlnFsDirectory* dir, const std::wstring& name);
+
+	// data is null for an empty file.
+	const uint8_t* data() const {
+		return _data;
+	}
+
+	size_t size() const {
+		return _size;
+	}
+};
+
+int WlnFsRemoveDirectory(const WlnFsDirectory* dir, const std::wstring& name);
+int WlnFsDeleteFile(const WlnFsDirectory* dir, const std::wstring& name);
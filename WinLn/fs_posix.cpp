@@ -0,0 +1,377 @@
+#include "common.h"
+#include "fs.h"
+#include "utf8.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// WlnFsNarrow converts path to the UTF-8 the POSIX APIs expect.
+static int WlnFsNarrow(const std::wstring& path, std::string& narrow) {
+	if(!WlnWideToUtf8(path.data(), path.size(), narrow)) {
+		return EILSEQ;
+	}
+	return 0;
+}
+
+WlnFsDirectory::WlnFsDirectory() : _fd(-1) {
+}
+
+WlnFsDirectory::~WlnFsDirectory() {
+	if(_fd >= 0) {
+		close(_fd);
+	}
+}
+
+int WlnFsDirectory::open(std::wstring_view path) {
+	// It may be opened again, for another directory.
+	if(_fd >= 0) {
+		close(_fd);
+		_fd = -1;
+	}
+
+	_path.assign(path);
+	if(_path.empty() || _path.back() != L'/') {
+		_path += L'/';
+	}
+
+	std::string npath;
+	if(int err = WlnFsNarrow(_path, npath)) return err;
+	_fd = ::open(npath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(_fd < 0) {
+		return errno;
+	}
+	return 0;
+}
+
+// WlnFsDirFd returns the descriptor that names in dir are relative to.
+static int WlnFsDirFd(const WlnFsDirectory* dir) {
+	return dir ? dir->fd() : AT_FDCWD;
+}
+
+bool WlnFsIsNotFound(int err) {
+	return err == ENOENT;
+}
+
+int WlnFsQueryFileInfo(const WlnFsDirectory* dir, const std::wstring& name, WlnFileInfo& info) {
+	std::string npath;
+	if(int err = WlnFsNarrow(name, npath)) return err;
+
+	struct stat st;
+	if(fstatat(WlnFsDirFd(dir), npath.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+		return errno;
+	}
+
+	info.attributes = 0;
+	info.reparseTag = WlnReparseTagNone;
+	if(S_ISDIR(st.st_mode)) {
+		info.attributes |= WlnFileAttributeDirectory;
+	} else if(S_ISLNK(st.st_mode)) {
+		// Like Windows directory symlinks, a symlink to a directory reports as both.
+		info.attributes |= WlnFileAttributeReparsePoint;
+		info.reparseTag = WlnReparseTagSymlink;
+		struct stat tst;
+		if(fstatat(WlnFsDirFd(dir), npath.c_str(), &tst, 0) == 0 && S_ISDIR(tst.st_mode)) {
+			info.attributes |= WlnFileAttributeDirectory;
+		}
+	}
+
+	info.id.volume = static_cast<uint64_t>(st.st_dev);
+	memset(info.id.id, 0, sizeof(info.id.id));
+	uint64_t ino = static_cast<uint64_t>(st.st_ino);
+	memcpy(info.id.id, &ino, sizeof(ino));
+	info.size = static_cast<uint64_t>(st.st_size);
+	return 0;
+}
+
+uint32_t WlnFsGetProcessId() {
+	return static_cast<uint32_t>(getpid());
+}
+
+int WlnFsGetCurrentDirectory(std::wstring& cwd) {
+	std::vector<char> buf(LONG_MAX_PATH);
+	if(!getcwd(buf.data(), buf.size())) {
+		return errno;
+	}
+	if(!WlnUtf8ToWide(buf.data(), strlen(buf.data()), cwd)) {
+		return EILSEQ;
+	}
+	return 0;
+}
+
+int WlnFsGetDriveDirectory(wchar_t drive, std::wstring& cwd) {
+	(void)drive;
+	(void)cwd;
+	return ENOTSUP;
+}
+
+int WlnFsCreateHardLink(const WlnFsDirectory* dir, const std::wstring& link, const std::wstring& target) {
+	std::string nlink, ntarget;
+	if(int err = WlnFsNarrow(link, nlink)) return err;
+	if(int err = WlnFsNarrow(target, ntarget)) return err;
+
+	if(linkat(AT_FDCWD, ntarget.c_str(), WlnFsDirFd(dir), nlink.c_str(), 0) != 0) {
+		return errno;
+	}
+	return 0;
+}
+
+int WlnFsCreateSymbolicLink(const WlnFsDirectory* dir, const std::wstring& link, const std::wstring& target, bool isDir) {
+	(void)isDir; // POSIX symlinks are untyped
+	std::string nlink, ntarget;
+	if(int err = WlnFsNarrow(link, nlink)) return err;
+	if(int err = WlnFsNarrow(target, ntarget)) return err;
+
+	if(symlinkat(ntarget.c_str(), WlnFsDirFd(dir), nlink.c_str()) != 0) {
+		return errno;
+	}
+	return 0;
+}
+
+// There are no junctions on POSIX; the nearest equivalent is a symbolic link
+// with an absolute target.
+int WlnFsCreateJunction(const WlnFsDirectory* dir, const std::wstring& link, const std::wstring& target) {
+	return WlnFsCreateSymbolicLink(dir, link, target, true);
+}
+
+int WlnFsReadLink(const WlnFsDirectory* dir, const std::wstring& name, std::wstring& target) {
+	std::string npath;
+	if(int err = WlnFsNarrow(name, npath)) return err;
+
+	std::vector<char> buf(256);
+	for(;;) {
+		ssize_t len = readlinkat(WlnFsDirFd(dir), npath.c_str(), buf.data(), buf.size());
+		if(len < 0) {
+			return errno;
+		}
+		if(static_cast<size_t>(len) < buf.size()) {
+			if(!WlnUtf8ToWide(buf.data(), len, target)) {
+				return EILSEQ;
+			}
+			return 0;
+		}
+		// it may have been truncated
+		buf.resize(buf.size() * 2);
+	}
+}
+
+int WlnFsRename(const WlnFsDirectory* dir, const std::wstring& from, const std::wstring& to) {
+	std::string nfrom, nto;
+	if(int err = WlnFsNarrow(from, nfrom)) return err;
+	if(int err = WlnFsNarrow(to, nto)) return err;
+
+	if(renameat(WlnFsDirFd(dir), nfrom.c_str(), WlnFsDirFd(dir), nto.c_str()) != 0) {
+		return errno;
+	}
+	return 0;
+}
+
+int WlnFsCreateDirectory(const WlnFsDirectory* dir, const std::wstring& name) {
+	std::string npath;
+	if(int err = WlnFsNarrow(name, npath)) return err;
+
+	if(mkdirat(WlnFsDirFd(dir), npath.c_str(), 0777) != 0) {
+		return errno;
+	}
+	return 0;
+}
+
+// Directories are read this much at a time.
+static constexpr size_t WlnFsDirectoryBufferSize = 64 * 1024;
+
+#ifdef __linux__
+// The record getdents64 fills the buffer with; glibc only declares one (and
+// the call itself) in recent versions.
+struct WlnFsDirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[1];
+};
+#endif
+
+WlnFsDirectoryReader::WlnFsDirectoryReader() : _offset(0), _length(0), _error(0), _fd(-1), _stream(nullptr) {
+}
+
+WlnFsDirectoryReader::~WlnFsDirectoryReader() {
+	if(_stream) {
+		closedir(static_cast<DIR*>(_stream));
+	}
+}
+
+int WlnFsDirectoryReader::open(const WlnFsDirectory& dir) {
+	_offset = _length = 0;
+	_error = 0;
+	_fd = dir.fd();
+#ifdef __linux__
+	_buffer.resize(WlnFsDirectoryBufferSize);
+	if(lseek(_fd, 0, SEEK_SET) < 0) {
+		return errno;
+	}
+#else
+	if(_stream) {
+		closedir(static_cast<DIR*>(_stream));
+		_stream = nullptr;
+	}
+	// closedir() closes the descriptor it reads from, and dir still needs its own.
+	int fd = fcntl(_fd, F_DUPFD_CLOEXEC, 0);
+	if(fd < 0) {
+		return errno;
+	}
+	_stream = fdopendir(fd);
+	if(!_stream) {
+		int err = errno;
+		close(fd);
+		return err;
+	}
+	rewinddir(static_cast<DIR*>(_stream));
+#endif
+	return 0;
+}
+
+// _fill reads the next batch of entries, returning false at the end or on error.
+bool WlnFsDirectoryReader::_fill() {
+#ifdef __linux__
+	long len = syscall(SYS_getdents64, _fd, _buffer.data(), _buffer.size());
+	if(len < 0) {
+		_error = errno;
+		return false;
+	}
+	_offset = 0;
+	_length = static_cast<size_t>(len);
+	return len > 0;
+#else
+	return false;
+#endif
+}
+
+// WlnFsEntryFromType fills in what a dirent's type says about an entry.
+static void WlnFsEntryFromType(unsigned char type, WlnFsDirectoryEntry& entry) {
+	entry.info = WlnFileInfo{};
+	entry.known = 0;
+	if(type == DT_DIR) {
+		entry.info.attributes = WlnFileAttributeDirectory;
+		entry.known = WlnFsEntryAttributes;
+	} else if(type != DT_UNKNOWN && type != DT_LNK) {
+		entry.known = WlnFsEntryAttributes;
+	}
+}
+
+bool WlnFsDirectoryReader::next(WlnFsDirectoryEntry& entry) {
+#ifdef __linux__
+	for(;;) {
+		if(_offset >= _length && !_fill()) return false;
+
+		auto ent = reinterpret_cast<const WlnFsDirent64*>(_buffer.data() + _offset);
+		_offset += ent->d_reclen;
+		if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+
+		if(!WlnUtf8ToWide(ent->d_name, strlen(ent->d_name), entry.name)) {
+			_error = EILSEQ;
+			return false;
+		}
+		WlnFsEntryFromType(ent->d_type, entry);
+		return true;
+	}
+#else
+	for(;;) {
+		errno = 0;
+		struct dirent* ent = readdir(static_cast<DIR*>(_stream));
+		if(!ent) {
+			_error = errno;
+			return false;
+		}
+		if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+
+		if(!WlnUtf8ToWide(ent->d_name, strlen(ent->d_name), entry.name)) {
+			_error = EILSEQ;
+			return false;
+		}
+		WlnFsEntryFromType(ent->d_type, entry);
+		return true;
+	}
+#endif
+}
+
+WlnFsMappedFile::WlnFsMappedFile() : _data(nullptr), _size(0) {
+}
+
+WlnFsMappedFile::~WlnFsMappedFile() {
+	if(_data) {
+		munmap(const_cast<uint8_t*>(_data), _size);
+	}
+}
+
+int WlnFsMappedFile::open(const WlnFsDirectory* dir, const std::wstring& name) {
+	std::string npath;
+	if(int err = WlnFsNarrow(name, npath)) return err;
+
+	int fd = openat(WlnFsDirFd(dir), npath.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+	if(fd < 0) {
+		return errno;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0) {
+		int err = errno;
+		close(fd);
+		return err;
+	}
+	if(static_cast<uint64_t>(st.st_size) > SIZE_MAX) {
+		close(fd);
+		return EFBIG;
+	}
+
+	_size = static_cast<size_t>(st.st_size);
+	if(_size == 0) {
+		close(fd);
+		return 0;
+	}
+	void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+	int err = data == MAP_FAILED ? errno : 0;
+	close(fd); // the mapping keeps the file
+	if(err) {
+		_size = 0;
+		return err;
+	}
+	madvise(data, _size, MADV_SEQUENTIAL);
+	_data = static_cast<const uint8_t*>(data);
+	return 0;
+}
+
+int WlnFsRemoveDirectory(const WlnFsDirectory* dir, const std::wstring& name) {
+	std::string npath;
+	if(int err = WlnFsNarrow(name, npath)) return err;
+
+	// RemoveDirectoryW removes directory links, too.
+	struct stat st;
+	if(fstatat(WlnFsDirFd(dir), npath.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISLNK(st.st_mode)) {
+		return unlinkat(WlnFsDirFd(dir), npath.c_str(), 0) != 0 ? errno : 0;
+	}
+
+	if(unlinkat(WlnFsDirFd(dir), npath.c_str(), AT_REMOVEDIR) != 0) {
+		return errno;
+	}
+	return 0;
+}
+
+int WlnFsDeleteFile(const WlnFsDirectory* dir, const std::wstring& name) {
+	std::string npath;
+	if(int err = WlnFsNarrow(name, npath)) return err;
+
+	if(unlinkat(WlnFsDirFd(dir), npath.c_str(), 0) != 0) {
+		return errno;
+	}
+	return 0;
+}
+#endif
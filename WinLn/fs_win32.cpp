@@ -0,0 +1,399 @@
+#include "common.h"
+#include "fs.h"
+#include "reparse.h"
+
+#ifdef _WIN32
+#include <winioctl.h>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Reparse buffers are built here, one per thread, and reused for every junction.
+static thread_local std::vector<uint8_t> reparseBuffer;
+
+WlnFsDirectory::WlnFsDirectory() : _handle(INVALID_HANDLE_VALUE) {
+}
+
+WlnFsDirectory::~WlnFsDirectory() {
+	if(_handle != INVALID_HANDLE_VALUE) {
+		CloseHandle(_handle);
+	}
+}
+
+int WlnFsDirectory::open(std::wstring_view path) {
+	// It may be opened again, for another directory.
+	if(_handle != INVALID_HANDLE_VALUE) {
+		CloseHandle(_handle);
+		_handle = INVALID_HANDLE_VALUE;
+	}
+
+	_path.assign(path);
+	if(_path.empty() || _path.back() != L'\\') {
+		_path += L'\\';
+	}
+
+	_handle = CreateFileW(_path.c_str(), FILE_LIST_DIRECTORY | FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+	if(_handle == INVALID_HANDLE_VALUE) {
+		return GetLastError();
+	}
+	return 0;
+}
+
+// WlnFsJoin returns the path for name (in dir), using scratch if it has to build one.
+static const std::wstring& WlnFsJoin(const WlnFsDirectory* dir, const std::wstring& name, std::wstring& scratch) {
+	if(!dir) return name;
+	scratch.reserve(dir->path().size() + name.size());
+	scratch.assign(dir->path());
+	scratch += name;
+	return scratch;
+}
+
+bool WlnFsIsNotFound(int err) {
+	return err == ERROR_FILE_NOT_FOUND;
+}
+
+int WlnFsQueryFileInfo(const WlnFsDirectory* dir, const std::wstring& name, WlnFileInfo& info) {
+	std::wstring scratch;
+	auto& path = WlnFsJoin(dir, name, scratch);
+	HANDLE hFile{CreateFileW(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_OPEN_REPARSE_POINT | FILE_FLAG_BACKUP_SEMANTICS, nullptr)};
+	if(hFile == INVALID_HANDLE_VALUE) {
+		return GetLastError();
+	}
+
+	FILE_ATTRIBUTE_TAG_INFO tag{};
+	FILE_ID_INFO fid{};
+	FILE_STANDARD_INFO standard{};
+	if(!GetFileInformationByHandleEx(hFile, FileAttributeTagInfo, &tag, sizeof(tag))
+		|| !GetFileInformationByHandleEx(hFile, FileIdInfo, &fid, sizeof(fid))
+		|| !GetFileInformationByHandleEx(hFile, FileStandardInfo, &standard, sizeof(standard))) {
+		int gle = GetLastError();
+		CloseHandle(hFile);
+		return gle;
+	}
+	CloseHandle(hFile);
+
+	info.attributes = 0;
+	if(tag.FileAttributes & FILE_ATTRIBUTE_DIRECTORY) info.attributes |= WlnFileAttributeDirectory;
+	if(tag.FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) info.attributes |= WlnFileAttributeReparsePoint;
+	info.reparseTag = (tag.FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) ? tag.ReparseTag : WlnReparseTagNone;
+
+	info.id.volume = fid.VolumeSerialNumber;
+	static_assert(sizeof(info.id.id) == sizeof(fid.FileId), "FILE_ID_128 must fit in WlnFileID");
+	memcpy(info.id.id, &fid.FileId.Identifier[0], sizeof(info.id.id));
+	info.size = static_cast<uint64_t>(standard.EndOfFile.QuadPart);
+	return 0;
+}
+
+uint32_t WlnFsGetProcessId() {
+	return GetCurrentProcessId();
+}
+
+int WlnFsGetCurrentDirectory(std::wstring& cwd) {
+	wchar_t buf[LONG_MAX_PATH];
+	DWORD len = GetCurrentDirectoryW(std::extent<decltype(buf)>::value, buf);
+	if(!len) {
+		return GetLastError();
+	}
+	cwd.assign(buf, len);
+	return 0;
+}
+
+int WlnFsGetDriveDirectory(wchar_t drive, std::wstring& cwd) {
+	// GetFullPathNameW knows every drive's current directory.
+	const wchar_t path[]{drive, L':', L'\0'};
+	wchar_t buf[LONG_MAX_PATH];
+	DWORD len = GetFullPathNameW(path, std::extent<decltype(buf)>::value, buf, nullptr);
+	if(!len) {
+		return GetLastError();
+	}
+	cwd.assign(buf, len);
+	return 0;
+}
+
+int WlnFsCreateHardLink(const WlnFsDirectory* dir, const std::wstring& name, const std::wstring& target) {
+	std::wstring scratch;
+	auto& link = WlnFsJoin(dir, name, scratch);
+	if(!CreateHardLinkW(link.c_str(), target.c_str(), nullptr)) {
+		return GetLastError();
+	}
+	return 0;
+}
+
+int WlnFsCreateSymbolicLink(const WlnFsDirectory* dir, const std::wstring& name, const std::wstring& target, bool isDir) {
+	std::wstring scratch;
+	auto& link = WlnFsJoin(dir, name, scratch);
+	int flags = SYMBOLIC_LINK_FLAG_ALLOW_UNPRIVILEGED_CREATE;
+	if(isDir) {
+		flags |= SYMBOLIC_LINK_FLAG_DIRECTORY;
+	}
+
+	if(!CreateSymbolicLinkW(link.c_str(), target.c_str(), flags)) {
+		return GetLastError();
+	}
+	return 0;
+}
+
+int WlnFsCreateJunction(const WlnFsDirectory* dir, const std::wstring& name, const std::wstring& target) {
+	std::wstring scratch;
+	auto& link = WlnFsJoin(dir, name, scratch);
+	std::wstring tabs{target};
+	if(tabs.compare(0, 4, L"\\\\?\\") == 0) {
+		tabs[1] = L'?'; // Replace "\\?\" with "\??\"
+	}
+
+	if(tabs.compare(0, 4, L"\\??\\") != 0) {
+		tabs = L"\\??\\" + tabs;
+	}
+
+	if(!CreateDirectoryW(link.c_str(), nullptr)) {
+		return GetLastError();
+	}
+
+	HANDLE hFile = INVALID_HANDLE_VALUE;
+	if(INVALID_HANDLE_VALUE == (hFile = CreateFileW(link.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_FLAG_OPEN_REPARSE_POINT | FILE_FLAG_BACKUP_SEMANTICS, nullptr))) {
+		int gle = GetLastError();
+		RemoveDirectoryW(link.c_str());
+		return gle;
+	}
+
+	// Like mklink /J, show the target as it was given.
+	if(!WlnBuildReparseBuffer(WlnReparseTagMountPoint, tabs, target, 0, reparseBuffer)) {
+		CloseHandle(hFile);
+		RemoveDirectoryW(link.c_str());
+		return ERROR_FILENAME_EXCED_RANGE;
+	}
+
+	if(!DeviceIoControl(hFile, FSCTL_SET_REPARSE_POINT, reparseBuffer.data(), static_cast<DWORD>(reparseBuffer.size()), nullptr, 0, nullptr, nullptr)) {
+		int gle = GetLastError();
+		CloseHandle(hFile);
+		RemoveDirectoryW(link.c_str());
+		return gle;
+	}
+	CloseHandle(hFile);
+	return 0;
+}
+
+int WlnFsReadLink(const WlnFsDirectory* dir, const std::wstring& name, std::wstring& target) {
+	std::wstring scratch;
+	auto& path = WlnFsJoin(dir, name, scratch);
+	HANDLE hFile{CreateFileW(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_OPEN_REPARSE_POINT | FILE_FLAG_BACKUP_SEMANTICS, nullptr)};
+	if(hFile == INVALID_HANDLE_VALUE) {
+		return GetLastError();
+	}
+
+	reparseBuffer.resize(WlnReparseMaximumSize);
+	DWORD len = 0;
+	if(!DeviceIoControl(hFile, FSCTL_GET_REPARSE_POINT, nullptr, 0, reparseBuffer.data(), static_cast<DWORD>(reparseBuffer.size()), &len, nullptr)) {
+		int gle = GetLastError();
+		CloseHandle(hFile);
+		return gle;
+	}
+	CloseHandle(hFile);
+
+	WlnReparseData data;
+	if(!WlnParseReparseBuffer(reparseBuffer.data(), len, data)) {
+		return ERROR_INVALID_REPARSE_DATA;
+	}
+
+	// The print name is what the link was created with; junctions made by
+	// older versions of WlnFsCreateJunction don't have one, so fall back to the NT path.
+	if(!data.printName.empty()) {
+		target = std::move(data.printName);
+	} else {
+		target = std::move(data.substituteName);
+		if(target.compare(0, 4, L"\\??\\") == 0) {
+			target.erase(0, 4);
+		}
+	}
+	return 0;
+}
+
+int WlnFsRename(const WlnFsDirectory* dir, const std::wstring& from, const std::wstring& to) {
+	std::wstring fromScratch, toScratch;
+	auto& fromPath = WlnFsJoin(dir, from, fromScratch);
+	auto& toPath = WlnFsJoin(dir, to, toScratch);
+	// On one volume this is a single NTFS rename; links are moved, not followed.
+	if(!MoveFileExW(fromPath.c_str(), toPath.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+		return GetLastError();
+	}
+	return 0;
+}
+
+int WlnFsCreateDirectory(const WlnFsDirectory* dir, const std::wstring& name) {
+	std::wstring scratch;
+	auto& path = WlnFsJoin(dir, name, scratch);
+	if(!CreateDirectoryW(path.c_str(), nullptr)) {
+		return GetLastError();
+	}
+	return 0;
+}
+
+// Directories are read this much at a time.
+static constexpr size_t WlnFsDirectoryBufferSize = 64 * 1024;
+
+WlnFsDirectoryReader::WlnFsDirectoryReader() : _offset(0), _length(0), _error(0), _handle(INVALID_HANDLE_VALUE), _volume(0), _class(FileIdExtdDirectoryInfo), _restart(true) {
+}
+
+WlnFsDirectoryReader::~WlnFsDirectoryReader() {
+}
+
+int WlnFsDirectoryReader::open(const WlnFsDirectory& dir) {
+	_buffer.resize(WlnFsDirectoryBufferSize);
+	_offset = _length = 0;
+	_error = 0;
+	_handle = dir.handle();
+	_restart = true;
+
+	// Every entry is on the directory's volume (mount points are reparse
+	// points, so we'd never look inside them).
+	FILE_ID_INFO fid{};
+	if(!GetFileInformationByHandleEx(_handle, FileIdInfo, &fid, sizeof(fid))) {
+		return GetLastError();
+	}
+	_volume = fid.VolumeSerialNumber;
+	return 0;
+}
+
+// _fill reads the next batch of entries, returning false at the end or on error.
+bool WlnFsDirectoryReader::_fill() {
+	for(;;) {
+		auto infoClass = static_cast<FILE_INFO_BY_HANDLE_CLASS>(_class);
+		if(_restart) {
+			infoClass = _class == FileIdExtdDirectoryInfo ? FileIdExtdDirectoryRestartInfo : FileFullDirectoryRestartInfo;
+		}
+		if(GetFileInformationByHandleEx(_handle, infoClass, _buffer.data(), static_cast<DWORD>(_buffer.size()))) {
+			_restart = false;
+			_offset = 0;
+			_length = _buffer.size();
+			return true;
+		}
+
+		int gle = GetLastError();
+		if(_restart && _class == FileIdExtdDirectoryInfo && (gle == ERROR_INVALID_PARAMETER || gle == ERROR_INVALID_LEVEL || gle == ERROR_NOT_SUPPORTED)) {
+			// FAT and some network filesystems don't have 128-bit file IDs.
+			_class = FileFullDirectoryInfo;
+			continue;
+		}
+		if(gle != ERROR_NO_MORE_FILES) {
+			_error = gle;
+		}
+		return false;
+	}
+}
+
+bool WlnFsDirectoryReader::next(WlnFsDirectoryEntry& entry) {
+	for(;;) {
+		if(_offset >= _length && !_fill()) return false;
+
+		DWORD nextOffset, attributes, reparseTag;
+		const WCHAR* name;
+		size_t nameLength;
+		uint64_t size;
+		if(_class == FileIdExtdDirectoryInfo) {
+			auto info = reinterpret_cast<const FILE_ID_EXTD_DIR_INFO*>(_buffer.data() + _offset);
+			nextOffset = info->NextEntryOffset;
+			attributes = info->FileAttributes;
+			reparseTag = info->ReparsePointTag;
+			name = info->FileName;
+			nameLength = info->FileNameLength / sizeof(WCHAR);
+			size = static_cast<uint64_t>(info->EndOfFile.QuadPart);
+			static_assert(sizeof(entry.info.id.id) == sizeof(info->FileId), "FILE_ID_128 must fit in WlnFileID");
+			memcpy(entry.info.id.id, &info->FileId.Identifier[0], sizeof(entry.info.id.id));
+			entry.info.id.volume = _volume;
+			entry.known = WlnFsEntryAll;
+		} else {
+			// For reparse points, EaSize holds the tag instead.
+			auto info = reinterpret_cast<const FILE_FULL_DIR_INFO*>(_buffer.data() + _offset);
+			nextOffset = info->NextEntryOffset;
+			attributes = info->FileAttributes;
+			reparseTag = info->EaSize;
+			name = info->FileName;
+			nameLength = info->FileNameLength / sizeof(WCHAR);
+			size = static_cast<uint64_t>(info->EndOfFile.QuadPart);
+			entry.info.id = WlnFileID{};
+			entry.known = WlnFsEntryAttributes | WlnFsEntrySize;
+		}
+		_offset = nextOffset ? _offset + nextOffset : _length;
+
+		if((nameLength == 1 && name[0] == L'.') || (nameLength == 2 && name[0] == L'.' && name[1] == L'.')) continue;
+
+		entry.name.assign(name, nameLength);
+		entry.info.attributes = 0;
+		if(attributes & FILE_ATTRIBUTE_DIRECTORY) entry.info.attributes |= WlnFileAttributeDirectory;
+		if(attributes & FILE_ATTRIBUTE_REPARSE_POINT) entry.info.attributes |= WlnFileAttributeReparsePoint;
+		entry.info.reparseTag = (attributes & FILE_ATTRIBUTE_REPARSE_POINT) ? reparseTag : WlnReparseTagNone;
+		entry.info.size = size;
+		return true;
+	}
+}
+
+WlnFsMappedFile::WlnFsMappedFile() : _data(nullptr), _size(0) {
+}
+
+WlnFsMappedFile::~WlnFsMappedFile() {
+	if(_data) {
+		UnmapViewOfFile(_data);
+	}
+}
+
+int WlnFsMappedFile::open(const WlnFsDirectory* dir, const std::wstring& name) {
+	std::wstring scratch;
+	auto& path = WlnFsJoin(dir, name, scratch);
+	HANDLE hFile{CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr)};
+	if(hFile == INVALID_HANDLE_VALUE) {
+		return GetLastError();
+	}
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(hFile, &size)) {
+		int gle = GetLastError();
+		CloseHandle(hFile);
+		return gle;
+	}
+	if(static_cast<uint64_t>(size.QuadPart) > SIZE_MAX) {
+		CloseHandle(hFile);
+		return ERROR_NOT_ENOUGH_MEMORY;
+	}
+	// Empty files can't be mapped.
+	if(size.QuadPart == 0) {
+		CloseHandle(hFile);
+		return 0;
+	}
+
+	HANDLE hMapping{CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr)};
+	int gle = hMapping ? 0 : GetLastError();
+	CloseHandle(hFile);
+	if(!hMapping) {
+		return gle;
+	}
+	// The view keeps the mapping (and the file) open.
+	void* data = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	gle = data ? 0 : GetLastError();
+	CloseHandle(hMapping);
+	if(!data) {
+		return gle;
+	}
+
+	_data = static_cast<const uint8_t*>(data);
+	_size = static_cast<size_t>(size.QuadPart);
+	return 0;
+}
+
+int WlnFsRemoveDirectory(const WlnFsDirectory* dir, const std::wstring& name) {
+	std::wstring scratch;
+	auto& path = WlnFsJoin(dir, name, scratch);
+	if(!RemoveDirectoryW(path.c_str())) {
+		return GetLastError();
+	}
+	return 0;
+}
+
+int WlnFsDeleteFile(const WlnFsDirectory* dir, const std::wstring& name) {
+	std::wstring scratch;
+	auto& path = WlnFsJoin(dir, name, scratch);
+	if(!DeleteFileW(path.c_str())) {
+		return GetLastError();
+	}
+	return 0;
+}
+#endif
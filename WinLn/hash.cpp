@@ -0,0 +1,121 @@
+#include "hash.h"
+
+#include <cstring>
+
+static constexpr uint64_t WlnHashPrime1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t WlnHashPrime2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t WlnHashPrime3 = 0x165667B19E3779F9ULL;
+static constexpr uint64_t WlnHashPrime4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr uint64_t WlnHashPrime5 = 0x27D4EB2F165667C5ULL;
+
+static uint64_t WlnRotateLeft(uint64_t v, int bits) {
+	return (v << bits) | (v >> (64 - bits));
+}
+
+// XXH64 is defined over little-endian words.
+static uint64_t WlnRead64(const uint8_t* p) {
+	uint64_t v = 0;
+	for(int i = 7; i >= 0; --i) {
+		v = (v << 8) | p[i];
+	}
+	return v;
+}
+
+static uint32_t WlnRead32(const uint8_t* p) {
+	return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+static uint64_t WlnHashRound(uint64_t lane, uint64_t input) {
+	lane += input * WlnHashPrime2;
+	lane = WlnRotateLeft(lane, 31);
+	return lane * WlnHashPrime1;
+}
+
+static uint64_t WlnHashMergeRound(uint64_t hash, uint64_t lane) {
+	hash ^= WlnHashRound(0, lane);
+	return hash * WlnHashPrime1 + WlnHashPrime4;
+}
+
+// WlnHashStripes consumes every whole stripe in data and returns how many bytes that was.
+static size_t WlnHashStripes(uint64_t (&lanes)[4], const uint8_t* data, size_t length) {
+	uint64_t l0 = lanes[0], l1 = lanes[1], l2 = lanes[2], l3 = lanes[3];
+	size_t done = 0;
+	for(; length - done >= 32; done += 32) {
+		l0 = WlnHashRound(l0, WlnRead64(data + done));
+		l1 = WlnHashRound(l1, WlnRead64(data + done + 8));
+		l2 = WlnHashRound(l2, WlnRead64(data + done + 16));
+		l3 = WlnHashRound(l3, WlnRead64(data + done + 24));
+	}
+	lanes[0] = l0;
+	lanes[1] = l1;
+	lanes[2] = l2;
+	lanes[3] = l3;
+	return done;
+}
+
+WlnHasher::WlnHasher() : _lanes{WlnHashPrime1 + WlnHashPrime2, WlnHashPrime2, 0, 0 - WlnHashPrime1}, _length(0), _pending{}, _pendingLength(0) {
+}
+
+void WlnHasher::update(const void* data, size_t length) {
+	auto p = static_cast<const uint8_t*>(data);
+	_length += length;
+
+	if(_pendingLength) {
+		size_t take = sizeof(_pending) - _pendingLength;
+		if(take > length) take = length;
+		memcpy(_pending + _pendingLength, p, take);
+		_pendingLength += take;
+		p += take;
+		length -= take;
+		if(_pendingLength < sizeof(_pending)) return;
+		WlnHashStripes(_lanes, _pending, sizeof(_pending));
+		_pendingLength = 0;
+	}
+
+	size_t done = WlnHashStripes(_lanes, p, length);
+	memcpy(_pending, p + done, length - done);
+	_pendingLength = length - done;
+}
+
+uint64_t WlnHasher::finish() const {
+	uint64_t hash;
+	if(_length >= 32) {
+		hash = WlnRotateLeft(_lanes[0], 1) + WlnRotateLeft(_lanes[1], 7) + WlnRotateLeft(_lanes[2], 12) + WlnRotateLeft(_lanes[3], 18);
+		for(auto lane : _lanes) {
+			hash = WlnHashMergeRound(hash, lane);
+		}
+	} else {
+		hash = WlnHashPrime5;
+	}
+	hash += _length;
+
+	const uint8_t* p = _pending;
+	size_t left = _pendingLength;
+	for(; left >= 8; p += 8, left -= 8) {
+		hash ^= WlnHashRound(0, WlnRead64(p));
+		hash = WlnRotateLeft(hash, 27) * WlnHashPrime1 + WlnHashPrime4;
+	}
+	if(left >= 4) {
+		hash ^= WlnRead32(p) * WlnHashPrime1;
+		hash = WlnRotateLeft(hash, 23) * WlnHashPrime2 + WlnHashPrime3;
+		p += 4;
+		left -= 4;
+	}
+	for(; left; ++p, --left) {
+		hash ^= *p * WlnHashPrime5;
+		hash = WlnRotateLeft(hash, 11) * WlnHashPrime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= WlnHashPrime2;
+	hash ^= hash >> 29;
+	hash *= WlnHashPrime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+uint64_t WlnHash(const void* data, size_t length) {
+	WlnHasher hasher;
+	hasher.update(data, length);
+	return hasher.finish();
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// WlnHasher computes XXH64 (seed 0) over data fed to it in pieces of any size.
+// It keeps four independent 64-bit lanes over each 32-byte stripe, so the
+// compiler can run them side by side; it's for spotting likely duplicates, not
+// for anything that has to resist an attacker.
+class WlnHasher {
+private:
+	uint64_t _lanes[4];
+	uint64_t _length;
+	uint8_t _pending[32]; // the start of a stripe we haven't got all of yet
+	size_t _pendingLength;
+
+public:
+	WlnHasher();
+
+	void update(const void* data, size_t length);
+	uint64_t finish() const;
+};
+
+// WlnHash hashes data in one go.
+uint64_t WlnHash(const void* data, size_t length);
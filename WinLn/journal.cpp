@@ -0,0 +1,257 @@
+#include "common.h"
+#include "fs.h"
+#include "journal.h"
+#include "utf8.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// WlnJournalError returns the system error for a failed stdio call.
+static int WlnJournalError() {
+#ifdef _WIN32
+	return _doserrno;
+#else
+	return errno;
+#endif
+}
+
+// The error to report for paths that can't be encoded or decoded.
+#ifdef _WIN32
+static constexpr int WlnJournalBadPath = ERROR_NO_UNICODE_TRANSLATION;
+#else
+static constexpr int WlnJournalBadPath = EILSEQ;
+#endif
+
+static bool WlnAppendJournalPath(std::string& out, const std::wstring& path) {
+	static thread_local std::string utf8;
+	if(!WlnWideToUtf8(path.data(), path.size(), utf8)) return false;
+	out += utf8;
+	out += '\0';
+	return true;
+}
+
+bool WlnAppendJournalRecord(std::string& out, const WlnJournalRecord& record) {
+	size_t mark = out.size();
+	out += static_cast<char>(record.op);
+	if(!WlnAppendJournalPath(out, record.path) || (record.op == WlnJournalOp::Displaced && !WlnAppendJournalPath(out, record.backup))) {
+		out.resize(mark);
+		return false;
+	}
+	return true;
+}
+
+enum class WlnJournalField {
+	Read,
+	Truncated, // no NUL before the end
+	Invalid,
+};
+
+// WlnReadJournalPath reads the NUL-terminated path at p, and moves p past it.
+static WlnJournalField WlnReadJournalPath(const char*& p, const char* end, std::wstring& path) {
+	auto nul = static_cast<const char*>(memchr(p, '\0', end - p));
+	if(!nul) return WlnJournalField::Truncated;
+	if(!WlnUtf8ToWide(p, nul - p, path)) return WlnJournalField::Invalid;
+	p = nul + 1;
+	return WlnJournalField::Read;
+}
+
+// WlnCancelJournalRecord takes the last record for path out of records.
+static void WlnCancelJournalRecord(std::vector<WlnJournalRecord>& records, const std::wstring& path) {
+	for(auto it = records.rbegin(); it != records.rend(); ++it) {
+		if(it->path == path) {
+			records.erase(std::next(it).base());
+			return;
+		}
+	}
+}
+
+bool WlnParseJournal(const char* data, size_t length, std::vector<WlnJournalRecord>& records) {
+	records.clear();
+	const char* end = data + length;
+	const char* p = data;
+	while(p < end) {
+		WlnJournalRecord record{static_cast<WlnJournalOp>(*p++), {}, {}};
+		switch(record.op) {
+		case WlnJournalOp::CreatedLink:
+		case WlnJournalOp::CreatedDirectory:
+		case WlnJournalOp::Displaced:
+		case WlnJournalOp::Cancelled:
+			break;
+		default:
+			return false;
+		}
+
+		auto field = WlnReadJournalPath(p, end, record.path);
+		if(field == WlnJournalField::Read && record.op == WlnJournalOp::Displaced) {
+			field = WlnReadJournalPath(p, end, record.backup);
+		}
+		// Running out of data can only happen in the last record.
+		if(field == WlnJournalField::Truncated) return true;
+		if(field == WlnJournalField::Invalid) return false;
+		if(record.op == WlnJournalOp::Cancelled) {
+			WlnCancelJournalRecord(records, record.path);
+			continue;
+		}
+		records.push_back(std::move(record));
+	}
+	return true;
+}
+
+int WlnUndoJournalRecord(const WlnJournalRecord& record) {
+	int err = 0;
+	switch(record.op) {
+	case WlnJournalOp::CreatedLink:
+		// It may be a directory link or a junction.
+		if(WlnFsRemoveDirectory(nullptr, record.path) == 0) return 0;
+		err = WlnFsDeleteFile(nullptr, record.path);
+		break;
+	case WlnJournalOp::CreatedDirectory:
+		err = WlnFsRemoveDirectory(nullptr, record.path);
+		break;
+	case WlnJournalOp::Displaced:
+		err = WlnFsRename(nullptr, record.backup, record.path);
+		break;
+	case WlnJournalOp::Cancelled:
+		break;
+	}
+	return WlnFsIsNotFound(err) ? 0 : err;
+}
+
+WlnJournal::WlnJournal() : _file(nullptr), _unsynced(0) {
+}
+
+WlnJournal::~WlnJournal() {
+	if(_file) {
+		fclose(_file);
+	}
+}
+
+// WlnOpenJournal opens the journal at path with fopen's mode.
+static int WlnOpenJournal(const std::wstring& path, const std::wstring& mode, FILE*& file) {
+#ifdef _WIN32
+	file = _wfopen(path.c_str(), mode.c_str());
+#else
+	std::string npath, nmode;
+	if(!WlnWideToUtf8(path.data(), path.size(), npath) || !WlnWideToUtf8(mode.data(), mode.size(), nmode)) {
+		return WlnJournalBadPath;
+	}
+	file = fopen(npath.c_str(), nmode.c_str());
+#endif
+	if(!file) {
+		return WlnJournalError();
+	}
+	return 0;
+}
+
+// WlnSyncJournal waits for everything written to file to reach the disk.
+static int WlnSyncJournal(FILE* file) {
+	if(fflush(file) != 0) {
+		return WlnJournalError();
+	}
+#ifdef _WIN32
+	if(_commit(_fileno(file)) != 0) {
+		return WlnJournalError();
+	}
+#else
+	if(fsync(fileno(file)) != 0) {
+		return errno;
+	}
+#endif
+	return 0;
+}
+
+int WlnJournal::create(const std::wstring& path) {
+	_path = path;
+	// x: a journal that's already there belongs to a run that didn't finish.
+	return WlnOpenJournal(path, L"wbx", _file);
+}
+
+int WlnJournal::record(WlnJournalRecord record) {
+	std::lock_guard<std::mutex> guard{_lock};
+	_encoded.clear();
+	if(!WlnAppendJournalRecord(_encoded, record)) {
+		return WlnJournalBadPath;
+	}
+	// Flushed straight away, so that it outlives the program; a change that
+	// isn't recorded can't be undone.
+	if(fwrite(_encoded.data(), 1, _encoded.size(), _file) != _encoded.size() || fflush(_file) != 0) {
+		return WlnJournalError();
+	}
+	if(record.op == WlnJournalOp::Cancelled) {
+		WlnCancelJournalRecord(_records, record.path);
+	} else {
+		_records.push_back(std::move(record));
+	}
+	if(++_unsynced >= WlnJournalGroupSize) {
+		return _sync();
+	}
+	return 0;
+}
+
+int WlnJournal::sync() {
+	std::lock_guard<std::mutex> guard{_lock};
+	return _sync();
+}
+
+// _sync waits for the records written so far to reach the disk.
+int WlnJournal::_sync() {
+	_unsynced = 0;
+	return WlnSyncJournal(_file);
+}
+
+int WlnJournal::close() {
+	if(!_file) return 0;
+	int err = sync();
+	fclose(_file);
+	_file = nullptr;
+	return err;
+}
+
+int WlnReadJournal(const std::wstring& path, std::vector<WlnJournalRecord>& records) {
+	FILE* file;
+	if(int err = WlnOpenJournal(path, L"rb", file)) return err;
+
+	std::string data;
+	char buf[64 * 1024];
+	size_t n;
+	while((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+		data.append(buf, n);
+	}
+	int err = ferror(file) ? WlnJournalError() : 0;
+	fclose(file);
+	if(err) return err;
+
+	if(!WlnParseJournal(data.data(), data.size(), records)) {
+#ifdef _WIN32
+		return ERROR_INVALID_DATA;
+#else
+		return EINVAL;
+#endif
+	}
+	return 0;
+}
+
+int WlnWriteJournal(const std::wstring& path, const std::vector<WlnJournalRecord>& records) {
+	std::string data;
+	for(auto& record : records) {
+		if(!WlnAppendJournalRecord(data, record)) return WlnJournalBadPath;
+	}
+
+	FILE* file;
+	if(int err = WlnOpenJournal(path, L"wb", file)) return err;
+	int err = 0;
+	if(fwrite(data.data(), 1, data.size(), file) != data.size()) {
+		err = WlnJournalError();
+	}
+	if(!err) {
+		err = WlnSyncJournal(file);
+	}
+	fclose(file);
+	return err;
+}
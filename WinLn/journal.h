@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A journal lists the changes a --transactional run has made to the
+// filesystem, so that they can be undone. Each record is written, and handed
+// to the system, before its change is made, so a change the program made is
+// always in the journal, even if it dies right after. Only waiting for them
+// to reach the disk is grouped, every WlnJournalGroupSize records (and at the
+// end), so a crash of the whole system can lose the last group. A change that
+// fails is followed by a Cancelled record, which takes the record before it
+// back out. A record can still name a change that never happened, if the run
+// died before making it; undoing it finds nothing to undo.
+//
+// Each record is an operation byte followed by NUL-terminated UTF-8 paths.
+
+enum class WlnJournalOp : char {
+	CreatedLink = 'L', // path
+	CreatedDirectory = 'D', // path
+	Displaced = 'M', // path was renamed to backup to make way for a link
+	Cancelled = 'C', // path: the last change recorded for it didn't happen
+};
+
+struct WlnJournalRecord {
+	WlnJournalOp op;
+	std::wstring path;
+	std::wstring backup; // Displaced only
+};
+
+constexpr size_t WlnJournalGroupSize = 1024;
+
+// WlnAppendJournalRecord encodes record onto out. It returns false if a path
+// can't be written as UTF-8.
+bool WlnAppendJournalRecord(std::string& out, const WlnJournalRecord& record);
+
+// WlnParseJournal decodes every whole record in data, leaving out the ones
+// that were cancelled (and the cancellations). A record cut short at the end
+// (by a crash mid-write) is ignored; anything else malformed makes it return
+// false.
+bool WlnParseJournal(const char* data, size_t length, std::vector<WlnJournalRecord>& records);
+
+// WlnUndoJournalRecord reverses one change. Something that's already gone
+// counts as undone.
+int WlnUndoJournalRecord(const WlnJournalRecord& record);
+
+// WlnJournal is the journal of the running transaction. It is safe to use
+// from multiple threads.
+class WlnJournal {
+private:
+	std::mutex _lock;
+	FILE* _file;
+	std::wstring _path;
+	std::string _encoded; // the record being written
+	size_t _unsynced; // records written since the last sync
+	std::vector<WlnJournalRecord> _records;
+
+	int _sync();
+
+public:
+	WlnJournal();
+	~WlnJournal();
+
+	WlnJournal(const WlnJournal&) = delete;
+	WlnJournal& operator=(const WlnJournal&) = delete;
+
+	// create starts a new journal at path, which mustn't exist yet.
+	int create(const std::wstring& path);
+
+	// record appends a change that is about to be made, or with Cancelled,
+	// takes back the last one recorded for the path.
+	int record(WlnJournalRecord record);
+
+	// sync waits for every record so far to reach the disk.
+	int sync();
+
+	// records returns every change made so far, oldest first, less the
+	// cancelled ones.
+	const std::vector<WlnJournalRecord>& records() const {
+		return _records;
+	}
+
+	// close syncs the journal and closes it.
+	int close();
+
+	const std::wstring& path() const {
+		return _path;
+	}
+};
+
+// WlnReadJournal reads every record in the journal at path.
+int WlnReadJournal(const std::wstring& path, std::vector<WlnJournalRecord>& records);
+
+// WlnWriteJournal replaces the journal at path with records, and waits for
+// them to reach the disk.
+int WlnWriteJournal(const std::wstring& path, const std::vector<WlnJournalRecord>& records);
@@ -0,0 +1,131 @@
+#include "common.h"
+#include "jsonl.h"
+#include "utf8.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+static constexpr size_t WlnBufferedWriterSize = 64 * 1024;
+
+static const char* WlnLinkOutcomeName(WlnLinkOutcome outcome) {
+	switch(outcome) {
+	case WlnLinkOutcome::Created:
+		return "created";
+	case WlnLinkOutcome::Unchanged:
+		return "unchanged";
+	case WlnLinkOutcome::Read:
+		return "read";
+	case WlnLinkOutcome::Verified:
+		return "verified";
+	case WlnLinkOutcome::Planned:
+		return "planned";
+	case WlnLinkOutcome::Failed:
+		return "failed";
+	}
+	return "unknown";
+}
+
+static void WlnAppendJsonEscape(uint32_t c, std::string& out) {
+	static const char hex[] = "0123456789abcdef";
+	out += "\\u";
+	out.push_back(hex[(c >> 12) & 0xF]);
+	out.push_back(hex[(c >> 8) & 0xF]);
+	out.push_back(hex[(c >> 4) & 0xF]);
+	out.push_back(hex[c & 0xF]);
+}
+
+void WlnAppendJsonString(std::wstring_view str, std::string& out) {
+	static thread_local std::string utf8;
+	bool valid = WlnWideToUtf8(str.data(), str.size(), utf8);
+
+	out.push_back('"');
+	if(valid) {
+		for(char ch : utf8) {
+			switch(ch) {
+			case '"':
+				out += "\\\"";
+				break;
+			case '\\':
+				out += "\\\\";
+				break;
+			default:
+				if(static_cast<unsigned char>(ch) < 0x20) {
+					WlnAppendJsonEscape(static_cast<unsigned char>(ch), out);
+				} else {
+					out.push_back(ch);
+				}
+			}
+		}
+	} else {
+		// Not representable in UTF-8 (a lone surrogate, say): escape every
+		// non-ASCII unit so that the name survives a round trip where possible.
+		for(wchar_t wc : str) {
+			uint32_t c = static_cast<uint32_t>(wc);
+			if(c == '"' || c == '\\') {
+				out.push_back('\\');
+				out.push_back(static_cast<char>(c));
+			} else if(c >= 0x20 && c < 0x80) {
+				out.push_back(static_cast<char>(c));
+			} else if(c > 0xFFFF) {
+				std::string one;
+				if(c <= 0x10FFFF && WlnWideToUtf8(&wc, 1, one)) {
+					out += one;
+				} else {
+					WlnAppendJsonEscape(0xFFFD, out);
+				}
+			} else {
+				WlnAppendJsonEscape(c, out);
+			}
+		}
+	}
+	out.push_back('"');
+}
+
+void WlnAppendJsonLine(const WlnLinkResult& result, std::string& out) {
+	out += "{\"link\":";
+	WlnAppendJsonString(result.link, out);
+	out += ",\"target\":";
+	WlnAppendJsonString(result.target, out);
+	out += ",\"type\":\"";
+	out += result.type;
+	out += "\",\"outcome\":\"";
+	out += WlnLinkOutcomeName(result.outcome);
+	out += "\",\"error\":";
+	out += std::to_string(result.error);
+	out += ",\"elapsed_us\":";
+	out += std::to_string(result.elapsedMicroseconds);
+	out += "}\n";
+}
+
+WlnBufferedWriter::WlnBufferedWriter(FILE* file) : _file(file) {
+#ifdef _WIN32
+	// JSON Lines end in \n; don't let the CRT turn that into \r\n.
+	_setmode(_fileno(file), _O_BINARY);
+#endif
+	_buffer.reserve(WlnBufferedWriterSize);
+}
+
+WlnBufferedWriter::~WlnBufferedWriter() {
+	flush();
+}
+
+void WlnBufferedWriter::write(std::string_view data) {
+	if(_buffer.size() + data.size() > WlnBufferedWriterSize) {
+		flush();
+		if(data.size() > WlnBufferedWriterSize) {
+			fwrite(data.data(), 1, data.size(), _file);
+			return;
+		}
+	}
+	_buffer.append(data);
+}
+
+void WlnBufferedWriter::flush() {
+	if(!_buffer.empty()) {
+		fwrite(_buffer.data(), 1, _buffer.size(), _file);
+		_buffer.clear();
+	}
+	fflush(_file);
+}
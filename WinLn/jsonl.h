@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+enum class WlnLinkOutcome {
+	Created,
+	Unchanged, // --skip-identical found it already in place
+	Read, // --read
+	Verified, // --verify found it as described
+	Planned, // --dry-run would create it
+	Failed,
+};
+
+// WlnLinkResult is one record of --output=jsonl.
+struct WlnLinkResult {
+	std::wstring link;
+	std::wstring target;
+	const char* type;
+	WlnLinkOutcome outcome;
+	int error; // the system error that failed the link, or 0
+	uint64_t elapsedMicroseconds;
+};
+
+// WlnAppendJsonString appends str to out as a quoted UTF-8 JSON string.
+void WlnAppendJsonString(std::wstring_view str, std::string& out);
+
+// WlnAppendJsonLine appends result to out as one line of JSON.
+void WlnAppendJsonLine(const WlnLinkResult& result, std::string& out);
+
+// WlnBufferedWriter collects output for file and hands it over in large
+// blocks. Whatever is left is written when it's destroyed.
+class WlnBufferedWriter {
+private:
+	FILE* _file;
+	std::string _buffer;
+
+public:
+	explicit WlnBufferedWriter(FILE* file);
+	~WlnBufferedWriter();
+
+	WlnBufferedWriter(const WlnBufferedWriter&) = delete;
+	WlnBufferedWriter& operator=(const WlnBufferedWriter&) = delete;
+
+	void write(std::string_view data);
+	void flush();
+};
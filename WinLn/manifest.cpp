@@ -0,0 +1,126 @@
+#include "common.h"
+#include "error.h"
+#include "manifest.h"
+#include "utf8.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+static constexpr size_t WlnManifestChunkSize = 64 * 1024;
+
+// WlnManifestDecode converts one field of a record to a wide string.
+static void WlnManifestDecode(const char* in, size_t inlen, std::wstring& out, size_t record) {
+	if(!WlnUtf8ToWide(in, inlen, out)) {
+		WlnAbortWithReason(L"manifest record %zu is not valid UTF-8", record);
+	}
+}
+
+// WlnManifestError returns the system error for a failed stdio call.
+static int WlnManifestError() {
+#ifdef _WIN32
+	return _doserrno;
+#else
+	return errno;
+#endif
+}
+
+WlnManifestReader::WlnManifestReader(const std::wstring& path, bool nulSeparated)
+	: _file(nullptr), _owned(false), _nulSeparated(nulSeparated), _eof(false), _buf(WlnManifestChunkSize), _pos(0), _len(0), _record(0) {
+	if(path == L"-") {
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+#endif
+		_file = stdin;
+	} else {
+#ifdef _WIN32
+		_file = _wfopen(path.c_str(), L"rb");
+#else
+		std::string npath;
+		if(WlnWideToUtf8(path.data(), path.size(), npath)) {
+			_file = fopen(npath.c_str(), "rb");
+		}
+#endif
+		if(!_file) {
+			WlnAbortWithSystemError(WlnManifestError(), L"Failed to open manifest `%ls'.", path.c_str());
+		}
+		_owned = true;
+	}
+
+	// Skip a UTF-8 BOM, if there is one.
+	_len = fread(_buf.data(), 1, _buf.size(), _file);
+	if(_len >= 3 && memcmp(_buf.data(), "\xEF\xBB\xBF", 3) == 0) {
+		_pos = 3;
+	}
+}
+
+WlnManifestReader::~WlnManifestReader() {
+	if(_owned) {
+		fclose(_file);
+	}
+}
+
+// _readToken reads bytes up to (and consumes) the next sep into out.
+// It returns false only if the manifest ended before any bytes were read.
+bool WlnManifestReader::_readToken(char sep, std::string& out) {
+	out.clear();
+	for(;;) {
+		if(_pos == _len) {
+			if(_eof) return !out.empty();
+			_pos = 0;
+			_len = fread(_buf.data(), 1, _buf.size(), _file);
+			if(_len == 0) {
+				if(ferror(_file)) {
+					WlnAbortWithSystemError(WlnManifestError(), L"Failed to read manifest.");
+				}
+				_eof = true;
+				continue;
+			}
+		}
+
+		const char* start = _buf.data() + _pos;
+		const char* end = static_cast<const char*>(memchr(start, sep, _len - _pos));
+		if(end) {
+			out.append(start, end);
+			_pos += (end - start) + 1;
+			return true;
+		}
+		out.append(start, _len - _pos);
+		_pos = _len;
+	}
+}
+
+bool WlnManifestReader::next(WlnManifestRecord& record) {
+	if(_nulSeparated) {
+		if(!_readToken('\0', _field)) return false;
+		++_record;
+		WlnManifestDecode(_field.data(), _field.size(), record.target, _record);
+		if(!_readToken('\0', _field)) {
+			_field.clear();
+		}
+		WlnManifestDecode(_field.data(), _field.size(), record.link, _record);
+		return true;
+	}
+
+	do {
+		if(!_readToken('\n', _field)) return false;
+		++_record;
+		if(!_field.empty() && _field.back() == '\r') {
+			_field.pop_back();
+		}
+	} while(_field.empty());
+
+	auto tab = _field.find('\t');
+	if(tab == std::string::npos) {
+		WlnManifestDecode(_field.data(), _field.size(), record.target, _record);
+		record.link.clear();
+	} else {
+		WlnManifestDecode(_field.data(), tab, record.target, _record);
+		WlnManifestDecode(_field.data() + tab + 1, _field.size() - tab - 1, record.link, _record);
+	}
+	return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct WlnManifestRecord {
+	std::wstring target;
+	std::wstring link; // empty if the record didn't specify one
+};
+
+// WlnManifestReader streams target/link records out of a manifest file (or
+// stdin, for "-"). Records are either "target<TAB>link" lines or, when
+// nulSeparated is set, "target\0link\0" pairs. Manifests are UTF-8.
+class WlnManifestReader {
+private:
+	FILE* _file;
+	bool _owned;
+	bool _nulSeparated;
+	bool _eof;
+
+	std::vector<char> _buf;
+	size_t _pos;
+	size_t _len;
+
+	std::string _field; // scratch for the raw bytes of the current record
+	size_t _record; // 1-based index of the current record, for diagnostics
+
+	bool _readToken(char sep, std::string& out);
+
+public:
+	WlnManifestReader(const std::wstring& path, bool nulSeparated);
+	~WlnManifestReader();
+
+	WlnManifestReader(const WlnManifestReader&) = delete;
+	WlnManifestReader& operator=(const WlnManifestReader&) = delete;
+
+	// next fills in record and returns true, or returns false at the end of the manifest.
+	bool next(WlnManifestRecord& record);
+
+	size_t get_record() const {
+		return _record;
+	}
+};
@@ -0,0 +1,309 @@
+#include "path.h"
+
+#include <algorithm>
+#include <cwctype>
+
+WlnPathArena::WlnPathArena() : _current(0), _used(0) {
+}
+
+wchar_t* WlnPathArena::reserve(size_t n) {
+	while(_current < _chunks.size() && _chunks[_current].size - _used < n + 1) {
+		++_current;
+		_used = 0;
+	}
+
+	if(_current == _chunks.size()) {
+		size_t size = std::max(ChunkSize, n + 1);
+		_chunks.push_back({std::unique_ptr<wchar_t[]>{new wchar_t[size]}, size});
+		_used = 0;
+	}
+	return _chunks[_current].data.get() + _used;
+}
+
+std::wstring_view WlnPathArena::commit(size_t n) {
+	wchar_t* start = _chunks[_current].data.get() + _used;
+	start[n] = L'\0';
+	_used += n + 1;
+	return {start, n};
+}
+
+std::wstring_view WlnPathArena::store(std::wstring_view str) {
+	wchar_t* buf = reserve(str.size());
+	std::copy(str.begin(), str.end(), buf);
+	return commit(str.size());
+}
+
+void WlnPathArena::reset() {
+	_current = 0;
+	_used = 0;
+}
+
+namespace {
+	enum class pathKind {
+		Relative, // a\b
+		Absolute, // C:\a, \\server\share\a, /a
+		Verbatim, // \\?\C:\a, \??\C:\a
+		Rooted, // \a (the root of the current drive)
+		DriveRelative, // C:a (relative to the current directory on C:)
+	};
+}
+
+static bool WlnIsDriveLetter(wchar_t c) {
+	return (c >= L'A' && c <= L'Z') || (c >= L'a' && c <= L'z');
+}
+
+// WlnClassifyPath works out what kind of path this is and how long its root is.
+static pathKind WlnClassifyPath(std::wstring_view path, WlnPathStyle style, size_t& rootLength) {
+	rootLength = 0;
+	if(style == WlnPathStyle::Posix) {
+		if(!path.empty() && path[0] == L'/') {
+			rootLength = 1;
+			return pathKind::Absolute;
+		}
+		return pathKind::Relative;
+	}
+
+	auto sep = [&](size_t i) {
+		return i < path.size() && WlnIsPathSeparator(path[i], style);
+	};
+
+	if(path.size() >= 4 && path[0] == L'\\' && (path[1] == L'\\' || path[1] == L'?') && path[2] == L'?' && path[3] == L'\\') {
+		rootLength = 4;
+		return pathKind::Verbatim;
+	}
+
+	if(sep(0) && sep(1)) {
+		// \\server\share\: the root runs through the share name
+		size_t i = 2;
+		for(int part = 0; part < 2 && i < path.size(); ++part) {
+			while(i < path.size() && !sep(i)) ++i;
+			if(i < path.size()) ++i; // the separator belongs to the root
+		}
+		rootLength = i;
+		return pathKind::Absolute;
+	}
+
+	if(sep(0)) {
+		rootLength = 1;
+		return pathKind::Rooted;
+	}
+
+	if(path.size() >= 2 && WlnIsDriveLetter(path[0]) && path[1] == L':') {
+		if(sep(2)) {
+			rootLength = 3;
+			return pathKind::Absolute;
+		}
+		rootLength = 2;
+		return pathKind::DriveRelative;
+	}
+
+	return pathKind::Relative;
+}
+
+size_t WlnPathRootLength(std::wstring_view path, WlnPathStyle style) {
+	size_t rootLength;
+	auto kind = WlnClassifyPath(path, style, rootLength);
+	return kind == pathKind::Absolute || kind == pathKind::Verbatim ? rootLength : 0;
+}
+
+namespace {
+	// normalizer appends path components to an output buffer, resolving . and ..
+	// as it goes. Nothing is ever removed from the root.
+	struct normalizer {
+		wchar_t* out;
+		size_t length;
+		size_t root;
+		wchar_t separator;
+		WlnPathStyle style;
+
+		void appendRoot(std::wstring_view r) {
+			for(wchar_t c : r) {
+				out[length++] = WlnIsPathSeparator(c, style) ? separator : c;
+			}
+			root = length;
+		}
+
+		void appendComponent(std::wstring_view c) {
+			if(c == L".") return;
+			if(c == L"..") {
+				while(length > root && out[length - 1] != separator) --length;
+				if(length > root) --length;
+				return;
+			}
+			if(length > 0 && out[length - 1] != separator) {
+				out[length++] = separator;
+			}
+			std::copy(c.begin(), c.end(), out + length);
+			length += c.size();
+		}
+
+		void appendComponents(std::wstring_view path, bool stripFinal) {
+			size_t pos = 0;
+			while(pos < path.size()) {
+				size_t end = pos;
+				while(end < path.size() && !WlnIsPathSeparator(path[end], style)) ++end;
+				auto c{path.substr(pos, end - pos)};
+				if(stripFinal && end == path.size() && c != L"." && c != L"..") {
+					// Win32 drops trailing dots and spaces from the final component.
+					size_t keep = c.find_last_not_of(L". ");
+					if(keep != std::wstring_view::npos) c = c.substr(0, keep + 1);
+				}
+				if(!c.empty()) appendComponent(c);
+				pos = end + 1;
+			}
+		}
+	};
+}
+
+WlnNormalizeResult WlnNormalizePath(std::wstring_view path, std::wstring_view cwd, WlnPathStyle style, WlnPathArena& arena, std::wstring_view& normalized) {
+	size_t rootLength;
+	auto kind = WlnClassifyPath(path, style, rootLength);
+
+	if(kind == pathKind::Verbatim) {
+		normalized = arena.store(path);
+		return WlnNormalizeResult::Ok;
+	}
+
+	size_t cwdRootLength;
+	WlnClassifyPath(cwd, style, cwdRootLength);
+
+	if(kind == pathKind::DriveRelative) {
+		bool sameDrive = cwdRootLength >= 2 && cwd[1] == L':' && towupper(cwd[0]) == towupper(path[0]);
+		if(!sameDrive) {
+			return WlnNormalizeResult::NeedsDriveDirectory;
+		}
+	}
+
+	wchar_t* buf = arena.reserve(cwd.size() + path.size() + 2);
+	normalizer n{buf, 0, 0, style == WlnPathStyle::Windows ? L'\\' : L'/', style};
+	bool stripFinal = style == WlnPathStyle::Windows;
+
+	switch(kind) {
+	case pathKind::Absolute:
+		n.appendRoot(path.substr(0, rootLength));
+		break;
+	case pathKind::Rooted:
+		n.appendRoot(cwd.substr(0, cwdRootLength));
+		if(n.length == 0 || buf[n.length - 1] != n.separator) {
+			buf[n.length++] = n.separator;
+			n.root = n.length;
+		}
+		break;
+	case pathKind::Relative:
+	case pathKind::DriveRelative:
+	default:
+		n.appendRoot(cwd.substr(0, cwdRootLength));
+		n.appendComponents(cwd.substr(cwdRootLength), false);
+		break;
+	}
+	n.appendComponents(path.substr(rootLength), stripFinal);
+
+	if(!path.empty() && WlnIsPathSeparator(path.back(), style) && n.length > 0 && buf[n.length - 1] != n.separator) {
+		buf[n.length++] = n.separator;
+	}
+
+	normalized = arena.commit(n.length);
+	return WlnNormalizeResult::Ok;
+}
+
+size_t WlnPathFilenameOffset(std::wstring_view path, WlnPathStyle style) {
+	size_t i = path.size();
+	while(i > 0 && !WlnIsPathSeparator(path[i - 1], style)) --i;
+	return i;
+}
+
+std::wstring_view WlnPathLeaf(std::wstring_view path, WlnPathStyle style) {
+	size_t end = path.size();
+	if(end > 1 && WlnIsPathSeparator(path[end - 1], style)) --end; // skip a trailing separator
+	size_t start = end;
+	while(start > 0 && !WlnIsPathSeparator(path[start - 1], style)) --start;
+
+	auto leaf{path.substr(start, end - start)};
+	if(style == WlnPathStyle::Windows && leaf.length() == 2 && leaf[1] == L':') {
+		// SPECIAL CASE: The filename for a drive (C:\) is its name (C)
+		return leaf.substr(0, 1);
+	}
+	return leaf;
+}
+
+WlnPathComponents::WlnPathComponents() : _root(0) {
+}
+
+void WlnPathComponents::assign(std::wstring_view path, WlnPathStyle style) {
+	_path.assign(path);
+	_components.clear();
+
+	size_t rootLength;
+	WlnClassifyPath(_path, style, rootLength);
+	_root = rootLength;
+
+	std::wstring_view rest{std::wstring_view{_path}.substr(_root)};
+	size_t pos = 0;
+	while(pos < rest.size()) {
+		size_t end = pos;
+		while(end < rest.size() && !WlnIsPathSeparator(rest[end], style)) ++end;
+		if(end != pos) _components.push_back(rest.substr(pos, end - pos));
+		pos = end + 1;
+	}
+}
+
+static bool WlnPathComponentEqual(std::wstring_view left, std::wstring_view right, WlnPathStyle style, WlnPathCase pathCase) {
+	if(left.size() != right.size()) return false;
+	for(size_t i = 0; i < left.size(); ++i) {
+		wchar_t l = left[i], r = right[i];
+		if(l == r) continue;
+		if(WlnIsPathSeparator(l, style) && WlnIsPathSeparator(r, style)) continue;
+		if(pathCase == WlnPathCase::Insensitive && towupper(l) == towupper(r)) continue;
+		return false;
+	}
+	return true;
+}
+
+bool WlnMakePathRelative(std::wstring_view path, const WlnPathComponents& base, WlnPathStyle style, WlnPathCase pathCase, std::wstring& relative) {
+	size_t rootLength;
+	WlnClassifyPath(path, style, rootLength);
+
+	// Drive letters and share names never depend on case on Windows.
+	auto rootCase = style == WlnPathStyle::Windows ? WlnPathCase::Insensitive : pathCase;
+	if(!WlnPathComponentEqual(path.substr(0, rootLength), base.root(), style, rootCase)) {
+		return false;
+	}
+
+	// Walk path's components alongside base's for as long as they agree.
+	auto& components = base.components();
+	size_t common = 0;
+	size_t pos = rootLength;
+	while(pos < path.size()) {
+		size_t end = pos;
+		while(end < path.size() && !WlnIsPathSeparator(path[end], style)) ++end;
+		if(end == pos) {
+			++pos;
+			continue;
+		}
+		if(common == components.size() || !WlnPathComponentEqual(path.substr(pos, end - pos), components[common], style, pathCase)) {
+			break;
+		}
+		++common;
+		pos = end;
+	}
+
+	wchar_t separator = style == WlnPathStyle::Windows ? L'\\' : L'/';
+	relative.clear();
+	for(size_t i = common; i < components.size(); ++i) {
+		if(!relative.empty()) relative += separator;
+		relative += L"..";
+	}
+
+	while(pos < path.size() && WlnIsPathSeparator(path[pos], style)) ++pos;
+	size_t end = path.size();
+	while(end > pos && WlnIsPathSeparator(path[end - 1], style)) --end;
+	if(pos < end) {
+		if(!relative.empty()) relative += separator;
+		relative.append(path, pos, end - pos);
+	}
+
+	if(relative.empty()) {
+		relative = L".";
+	}
+	return true;
+}
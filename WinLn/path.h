@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Lexical path manipulation. Nothing in here touches the filesystem or the OS,
+// so every path style can be exercised on every platform.
+
+enum class WlnPathStyle {
+	Windows, // C:\a\b, \\server\share\a, \\?\C:\a; both \ and / separate
+	Posix, // /a/b
+};
+
+#ifdef _WIN32
+constexpr WlnPathStyle WlnNativePathStyle = WlnPathStyle::Windows;
+#else
+constexpr WlnPathStyle WlnNativePathStyle = WlnPathStyle::Posix;
+#endif
+
+// WlnPathArena hands out NUL-terminated strings from large reusable chunks.
+// Everything it returns stays valid until the next reset(); after the first
+// few paths, normalizing doesn't allocate at all.
+class WlnPathArena {
+private:
+	static constexpr size_t ChunkSize = 64 * 1024;
+
+	struct chunk {
+		std::unique_ptr<wchar_t[]> data;
+		size_t size;
+	};
+	std::vector<chunk> _chunks;
+	size_t _current;
+	size_t _used;
+
+public:
+	WlnPathArena();
+
+	WlnPathArena(const WlnPathArena&) = delete;
+	WlnPathArena& operator=(const WlnPathArena&) = delete;
+
+	// reserve returns room for at least n characters (plus a terminator).
+	// Only the latest reservation may be committed.
+	wchar_t* reserve(size_t n);
+	// commit keeps the first n characters of the latest reservation and terminates them.
+	std::wstring_view commit(size_t n);
+
+	// store copies str into the arena.
+	std::wstring_view store(std::wstring_view str);
+
+	void reset();
+};
+
+enum class WlnNormalizeResult {
+	Ok,
+	// The path is relative to the current directory of another drive (C:foo);
+	// the caller must look that up and normalize the rest of the path against it.
+	NeedsDriveDirectory,
+};
+
+// WlnNormalizePath makes path absolute against cwd (which must already be
+// absolute and normalized) and collapses separators, . and .. the way
+// GetFullPathNameW does. A trailing separator is preserved. Windows paths
+// come out with \ separators; \\?\ and \??\ paths are returned untouched.
+WlnNormalizeResult WlnNormalizePath(std::wstring_view path, std::wstring_view cwd, WlnPathStyle style, WlnPathArena& arena, std::wstring_view& normalized);
+
+// WlnPathRootLength returns the length of path's root (C:\, \\server\share\,
+// /), or 0 if it doesn't have one.
+size_t WlnPathRootLength(std::wstring_view path, WlnPathStyle style);
+
+// WlnPathFilenameOffset returns the offset of the final component of an
+// absolute path, or its length if it ends in a separator.
+size_t WlnPathFilenameOffset(std::wstring_view path, WlnPathStyle style);
+
+// WlnPathLeaf returns the final component of path, ignoring one trailing
+// separator. The leaf of a drive root (C:\) is the drive letter.
+std::wstring_view WlnPathLeaf(std::wstring_view path, WlnPathStyle style = WlnNativePathStyle);
+
+enum class WlnPathCase {
+	Sensitive,
+	Insensitive, // compare components by their upper-case forms, like NTFS does
+};
+
+#ifdef _WIN32
+constexpr WlnPathCase WlnNativePathCase = WlnPathCase::Insensitive;
+#else
+constexpr WlnPathCase WlnNativePathCase = WlnPathCase::Sensitive;
+#endif
+
+// WlnPathComponents is a normalized absolute path split into its root and
+// components. Splitting a directory once lets many paths be made relative to
+// it cheaply.
+class WlnPathComponents {
+private:
+	std::wstring _path;
+	size_t _root;
+	std::vector<std::wstring_view> _components; // views into _path
+
+public:
+	WlnPathComponents();
+
+	void assign(std::wstring_view path, WlnPathStyle style);
+
+	const std::wstring& path() const {
+		return _path;
+	}
+
+	std::wstring_view root() const {
+		return std::wstring_view{_path}.substr(0, _root);
+	}
+
+	const std::vector<std::wstring_view>& components() const {
+		return _components;
+	}
+};
+
+// WlnMakePathRelative computes the relative path from the directory base to
+// path, which must be normalized and absolute. It returns false if there is
+// no relative path between them (they're on different drives or shares).
+bool WlnMakePathRelative(std::wstring_view path, const WlnPathComponents& base, WlnPathStyle style, WlnPathCase pathCase, std::wstring& relative);
+
+inline bool WlnIsPathSeparator(wchar_t c, WlnPathStyle style) {
+	return c == L'/' || (style == WlnPathStyle::Windows && c == L'\\');
+}
@@ -0,0 +1,130 @@
+#include "reparse.h"
+
+// REPARSE_DATA_BUFFER starts with the tag, the length of everything after this
+// header, and a reserved word. Both link types follow that with the offsets
+// and lengths (in bytes, relative to PathBuffer) of the two names; symbolic
+// links have a flags word before PathBuffer.
+static constexpr size_t WlnReparseHeaderSize = 8;
+static constexpr size_t WlnReparseNamesSize = 8;
+static constexpr size_t WlnReparseFlagsSize = 4;
+
+static size_t WlnReparsePathBufferOffset(uint32_t tag) {
+	return WlnReparseHeaderSize + WlnReparseNamesSize + (tag == WlnReparseTagSymlink ? WlnReparseFlagsSize : 0);
+}
+
+static void WlnPut16(uint8_t* p, uint16_t v) {
+	p[0] = static_cast<uint8_t>(v);
+	p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+static void WlnPut32(uint8_t* p, uint32_t v) {
+	WlnPut16(p, static_cast<uint16_t>(v));
+	WlnPut16(p + 2, static_cast<uint16_t>(v >> 16));
+}
+
+static uint16_t WlnGet16(const uint8_t* p) {
+	return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t WlnGet32(const uint8_t* p) {
+	return WlnGet16(p) | (static_cast<uint32_t>(WlnGet16(p + 2)) << 16);
+}
+
+// WlnUtf16Length returns how many UTF-16 units str needs.
+static size_t WlnUtf16Length(std::wstring_view str) {
+	size_t len = str.size();
+	if constexpr(sizeof(wchar_t) > 2) {
+		for(wchar_t c : str) {
+			if(static_cast<uint32_t>(c) > 0xFFFF) ++len;
+		}
+	}
+	return len;
+}
+
+// WlnPutUtf16 writes str at p as UTF-16LE, followed by a NUL.
+static void WlnPutUtf16(uint8_t* p, std::wstring_view str) {
+	for(wchar_t wc : str) {
+		uint32_t c = static_cast<uint32_t>(wc);
+		if(c > 0xFFFF) {
+			c -= 0x10000;
+			WlnPut16(p, static_cast<uint16_t>(0xD800 | (c >> 10)));
+			p += 2;
+			c = 0xDC00 | (c & 0x3FF);
+		}
+		WlnPut16(p, static_cast<uint16_t>(c));
+		p += 2;
+	}
+	WlnPut16(p, 0);
+}
+
+static void WlnGetUtf16(const uint8_t* p, size_t units, std::wstring& str) {
+	str.clear();
+	str.reserve(units);
+	for(size_t i = 0; i < units; ++i) {
+		uint32_t c = WlnGet16(p + 2 * i);
+		if constexpr(sizeof(wchar_t) > 2) {
+			// Pair up surrogates; lone ones are kept as they are, like Windows would.
+			if(c >= 0xD800 && c <= 0xDBFF && i + 1 < units) {
+				uint32_t low = WlnGet16(p + 2 * (i + 1));
+				if(low >= 0xDC00 && low <= 0xDFFF) {
+					c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+					++i;
+				}
+			}
+		}
+		str.push_back(static_cast<wchar_t>(c));
+	}
+}
+
+bool WlnBuildReparseBuffer(uint32_t tag, std::wstring_view substituteName, std::wstring_view printName, uint32_t flags, std::vector<uint8_t>& buffer) {
+	if(tag != WlnReparseTagMountPoint && tag != WlnReparseTagSymlink) return false;
+
+	// Both names are stored NUL-terminated, substitute name first.
+	size_t subUnits = WlnUtf16Length(substituteName);
+	size_t printUnits = WlnUtf16Length(printName);
+	size_t pathOffset = WlnReparsePathBufferOffset(tag);
+	size_t length = pathOffset + 2 * (subUnits + 1 + printUnits + 1);
+	if(length > WlnReparseMaximumSize) return false;
+
+	buffer.assign(length, 0);
+	uint8_t* p = buffer.data();
+	WlnPut32(p, tag);
+	WlnPut16(p + 4, static_cast<uint16_t>(length - WlnReparseHeaderSize));
+	WlnPut16(p + 8, 0);
+	WlnPut16(p + 10, static_cast<uint16_t>(2 * subUnits));
+	WlnPut16(p + 12, static_cast<uint16_t>(2 * (subUnits + 1)));
+	WlnPut16(p + 14, static_cast<uint16_t>(2 * printUnits));
+	if(tag == WlnReparseTagSymlink) {
+		WlnPut32(p + 16, flags);
+	}
+	WlnPutUtf16(p + pathOffset, substituteName);
+	WlnPutUtf16(p + pathOffset + 2 * (subUnits + 1), printName);
+	return true;
+}
+
+bool WlnParseReparseBuffer(const uint8_t* buffer, size_t length, WlnReparseData& data) {
+	if(length < WlnReparseHeaderSize) return false;
+
+	uint32_t tag = WlnGet32(buffer);
+	if(tag != WlnReparseTagMountPoint && tag != WlnReparseTagSymlink) return false;
+
+	// Trust the header's length, as long as the buffer really has that much.
+	size_t dataLength = WlnGet16(buffer + 4);
+	if(WlnReparseHeaderSize + dataLength > length) return false;
+	length = WlnReparseHeaderSize + dataLength;
+
+	size_t pathOffset = WlnReparsePathBufferOffset(tag);
+	if(length < pathOffset) return false;
+
+	size_t subOffset = WlnGet16(buffer + 8), subLength = WlnGet16(buffer + 10);
+	size_t printOffset = WlnGet16(buffer + 12), printLength = WlnGet16(buffer + 14);
+	size_t pathLength = length - pathOffset;
+	if((subOffset | subLength | printOffset | printLength) & 1) return false;
+	if(subOffset + subLength > pathLength || printOffset + printLength > pathLength) return false;
+
+	data.tag = tag;
+	data.flags = tag == WlnReparseTagSymlink ? WlnGet32(buffer + 16) : 0;
+	WlnGetUtf16(buffer + pathOffset + subOffset, subLength / 2, data.substituteName);
+	WlnGetUtf16(buffer + pathOffset + printOffset, printLength / 2, data.printName);
+	return true;
+}
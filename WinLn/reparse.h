@@ -0,0 +1,36 @@
+#pragma once
+
+#include "fs.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Reparse point data in the REPARSE_DATA_BUFFER layout that
+// FSCTL_SET_REPARSE_POINT takes and FSCTL_GET_REPARSE_POINT returns. This is
+// only byte layout (little-endian, names in UTF-16), so it builds and can be
+// tested everywhere, even though only the Win32 backend uses it.
+
+// Windows can't store more reparse data than this for a single file.
+constexpr size_t WlnReparseMaximumSize = 16 * 1024;
+
+enum WlnReparseSymlinkFlag : uint32_t {
+	WlnReparseSymlinkRelative = 0x1, // SYMLINK_FLAG_RELATIVE
+};
+
+struct WlnReparseData {
+	uint32_t tag; // WlnReparseTagMountPoint or WlnReparseTagSymlink
+	std::wstring substituteName; // the NT path (\??\C:\a) the filesystem follows
+	std::wstring printName; // the path to show people
+	uint32_t flags; // WlnReparseSymlinkFlag; symbolic links only
+};
+
+// WlnBuildReparseBuffer lays out a mount point or symbolic link reparse buffer
+// in buffer, reusing its storage. It returns false if the names don't fit.
+bool WlnBuildReparseBuffer(uint32_t tag, std::wstring_view substituteName, std::wstring_view printName, uint32_t flags, std::vector<uint8_t>& buffer);
+
+// WlnParseReparseBuffer reads a mount point or symbolic link reparse buffer
+// back. It returns false for other tags and for malformed buffers.
+bool WlnParseReparseBuffer(const uint8_t* buffer, size_t length, WlnReparseData& data);
@@ -0,0 +1,141 @@
+#include "stats.h"
+#include "error.h"
+
+#include <cstring>
+#include <mutex>
+
+bool wlnStatsEnabled = false;
+
+// Histogram buckets are exact below 32ns. Above that, each power of two is
+// split into 16, up to 2^48ns (a few days), which is plenty.
+static constexpr int WlnStatSubBits = 4;
+static constexpr int WlnStatMaxExponent = 47;
+static constexpr size_t WlnStatBuckets = (2 << WlnStatSubBits) + (WlnStatMaxExponent - WlnStatSubBits) * (1 << WlnStatSubBits);
+
+namespace {
+	struct WlnStatHistogram {
+		uint64_t count;
+		uint64_t total;
+		uint64_t buckets[WlnStatBuckets];
+
+		void merge(const WlnStatHistogram& other) {
+			count += other.count;
+			total += other.total;
+			for(size_t i = 0; i < WlnStatBuckets; ++i) {
+				buckets[i] += other.buckets[i];
+			}
+		}
+	};
+
+	using WlnStatHistograms = WlnStatHistogram[static_cast<size_t>(WlnStatPhase::Count)];
+
+	// Threads that have ended leave their timings here.
+	std::mutex retiredLock;
+	WlnStatHistograms retired;
+
+	struct WlnStatThread {
+		WlnStatHistograms phases;
+
+		~WlnStatThread() {
+			std::lock_guard<std::mutex> guard{retiredLock};
+			for(size_t i = 0; i < static_cast<size_t>(WlnStatPhase::Count); ++i) {
+				retired[i].merge(phases[i]);
+			}
+		}
+	};
+
+	thread_local WlnStatThread t_stats;
+}
+
+static size_t WlnStatBucket(uint64_t ns) {
+	if(ns < (2u << WlnStatSubBits)) return static_cast<size_t>(ns);
+
+	int exponent = WlnStatSubBits + 1;
+	while(exponent < WlnStatMaxExponent && (ns >> (exponent + 1)) != 0) {
+		++exponent;
+	}
+	if((ns >> (exponent + 1)) != 0) {
+		return WlnStatBuckets - 1;
+	}
+	size_t sub = (ns >> (exponent - WlnStatSubBits)) & ((1 << WlnStatSubBits) - 1);
+	return (2 << WlnStatSubBits) + (exponent - WlnStatSubBits - 1) * (1 << WlnStatSubBits) + sub;
+}
+
+// WlnStatBucketValue returns the middle of the values that land in bucket.
+static uint64_t WlnStatBucketValue(size_t bucket) {
+	if(bucket < (2u << WlnStatSubBits)) return bucket;
+
+	size_t above = bucket - (2 << WlnStatSubBits);
+	int shift = static_cast<int>(above >> WlnStatSubBits) + 1;
+	uint64_t low = (static_cast<uint64_t>((1 << WlnStatSubBits) + (above & ((1 << WlnStatSubBits) - 1)))) << shift;
+	return low + (uint64_t{1} << shift) / 2;
+}
+
+void WlnRecordStat(WlnStatPhase phase, uint64_t nanoseconds) {
+	auto& histogram = t_stats.phases[static_cast<size_t>(phase)];
+	++histogram.count;
+	histogram.total += nanoseconds;
+	++histogram.buckets[WlnStatBucket(nanoseconds)];
+}
+
+// WlnStatPercentile returns the value that fraction of the timings in
+// histogram are no longer than.
+static uint64_t WlnStatPercentile(const WlnStatHistogram& histogram, double fraction) {
+	if(histogram.count == 0) return 0;
+	uint64_t rank = static_cast<uint64_t>(fraction * histogram.count);
+	if(rank == 0) rank = 1;
+	uint64_t seen = 0;
+	for(size_t i = 0; i < WlnStatBuckets; ++i) {
+		seen += histogram.buckets[i];
+		if(seen >= rank) return WlnStatBucketValue(i);
+	}
+	return WlnStatBucketValue(WlnStatBuckets - 1);
+}
+
+WlnStatSummary WlnSummarizeStats(WlnStatPhase phase) {
+	WlnStatHistogram histogram;
+	{
+		std::lock_guard<std::mutex> guard{retiredLock};
+		histogram = retired[static_cast<size_t>(phase)];
+	}
+	histogram.merge(t_stats.phases[static_cast<size_t>(phase)]);
+	return WlnStatSummary{histogram.count, histogram.total, WlnStatPercentile(histogram, 0.5), WlnStatPercentile(histogram, 0.99)};
+}
+
+void WlnResetStats() {
+	std::lock_guard<std::mutex> guard{retiredLock};
+	memset(&retired, 0, sizeof(retired));
+	memset(&t_stats.phases, 0, sizeof(t_stats.phases));
+}
+
+const wchar_t* WlnStatPhaseName(WlnStatPhase phase) {
+	switch(phase) {
+	case WlnStatPhase::ResolvePath:
+		return L"resolve path";
+	case WlnStatPhase::QueryFileInfo:
+		return L"query attributes";
+	case WlnStatPhase::RemoveExisting:
+		return L"remove existing";
+	case WlnStatPhase::CreateLink:
+		return L"create link";
+	case WlnStatPhase::ReplaceLink:
+		return L"replace link";
+	case WlnStatPhase::CreateDirectory:
+		return L"create directory";
+	case WlnStatPhase::Count:
+		break;
+	}
+	return L"unknown";
+}
+
+void WlnPrintStats() {
+	if(!wlnStatsEnabled) return;
+
+	WlnPrintDiagnostic(L"%-18ls %10ls %12ls %10ls %10ls\r\n", L"phase", L"count", L"total ms", L"p50 us", L"p99 us");
+	for(size_t i = 0; i < static_cast<size_t>(WlnStatPhase::Count); ++i) {
+		auto phase = static_cast<WlnStatPhase>(i);
+		auto summary{WlnSummarizeStats(phase)};
+		if(summary.count == 0) continue;
+		WlnPrintDiagnostic(L"%-18ls %10llu %12.1f %10.1f %10.1f\r\n", WlnStatPhaseName(phase), static_cast<unsigned long long>(summary.count), summary.totalNanoseconds / 1e6, summary.p50Nanoseconds / 1e3, summary.p99Nanoseconds / 1e3);
+	}
+}
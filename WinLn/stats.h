@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// --stats times each phase of making links. Every thread keeps its own
+// histograms, so recording a timing is a handful of adds, and hands them over
+// when it ends. Percentiles come from the histograms, to within 1/16 of the
+// value.
+
+enum class WlnStatPhase {
+	ResolvePath,
+	QueryFileInfo,
+	RemoveExisting, // -f getting the old destination out of the way
+	CreateLink,
+	ReplaceLink, // --atomic renaming the new link into place
+	CreateDirectory,
+	Count,
+};
+
+// Whether --stats is on. It's set once, before any threads start.
+extern bool wlnStatsEnabled;
+
+// WlnRecordStat records that one call of phase took nanoseconds.
+void WlnRecordStat(WlnStatPhase phase, uint64_t nanoseconds);
+
+// WlnStatTimer times a call of phase, from its construction to its
+// destruction. With --stats off it costs a test of wlnStatsEnabled.
+class WlnStatTimer {
+private:
+	WlnStatPhase _phase;
+	bool _running;
+	std::chrono::steady_clock::time_point _start;
+
+public:
+	explicit WlnStatTimer(WlnStatPhase phase): _phase(phase), _running(wlnStatsEnabled) {
+		if(_running) {
+			_start = std::chrono::steady_clock::now();
+		}
+	}
+
+	~WlnStatTimer() {
+		if(_running) {
+			WlnRecordStat(_phase, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count());
+		}
+	}
+
+	WlnStatTimer(const WlnStatTimer&) = delete;
+	WlnStatTimer& operator=(const WlnStatTimer&) = delete;
+};
+
+struct WlnStatSummary {
+	uint64_t count;
+	uint64_t totalNanoseconds;
+	uint64_t p50Nanoseconds;
+	uint64_t p99Nanoseconds;
+};
+
+// WlnSummarizeStats summarizes phase over every thread that has ended, and
+// the calling one.
+WlnStatSummary WlnSummarizeStats(WlnStatPhase phase);
+
+// WlnResetStats forgets the timings of every thread that has ended, and the
+// calling one.
+void WlnResetStats();
+
+// WlnStatPhaseName returns how --stats labels phase.
+const wchar_t* WlnStatPhaseName(WlnStatPhase phase);
+
+// WlnPrintStats writes a table of every phase that was timed to stderr, if
+// --stats is on.
+void WlnPrintStats();
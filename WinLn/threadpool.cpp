@@ -0,0 +1,86 @@
+#include "threadpool.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+	struct WlnWorkRange {
+		std::mutex lock;
+		size_t begin;
+		size_t end;
+	};
+}
+
+// WlnTakeWork pops the next index off the front of the range.
+static bool WlnTakeWork(WlnWorkRange& range, size_t& index) {
+	std::lock_guard<std::mutex> guard{range.lock};
+	if(range.begin == range.end) return false;
+	index = range.begin++;
+	return true;
+}
+
+// WlnStealWork moves the back half of victim's range into thief's
+// (which must be empty) and pops the first index of it.
+static bool WlnStealWork(WlnWorkRange& victim, WlnWorkRange& thief, size_t& index) {
+	size_t begin, end;
+	{
+		std::lock_guard<std::mutex> guard{victim.lock};
+		size_t remaining = victim.end - victim.begin;
+		if(remaining == 0) return false;
+		begin = victim.begin + remaining / 2;
+		end = victim.end;
+		victim.end = begin;
+	}
+
+	std::lock_guard<std::mutex> guard{thief.lock};
+	thief.begin = begin + 1;
+	thief.end = end;
+	index = begin;
+	return true;
+}
+
+void WlnParallelFor(size_t count, unsigned jobs, const std::function<void(size_t)>& work) {
+	size_t nthreads = std::max<size_t>(1, std::min<size_t>(jobs, count));
+	if(nthreads == 1) {
+		for(size_t i = 0; i < count; ++i) {
+			work(i);
+		}
+		return;
+	}
+
+	std::unique_ptr<WlnWorkRange[]> ranges{new WlnWorkRange[nthreads]};
+	for(size_t t = 0; t < nthreads; ++t) {
+		ranges[t].begin = count * t / nthreads;
+		ranges[t].end = count * (t + 1) / nthreads;
+	}
+
+	auto worker = [&](size_t self) {
+		for(;;) {
+			size_t index;
+			bool found = WlnTakeWork(ranges[self], index);
+			for(size_t v = 1; !found && v < nthreads; ++v) {
+				found = WlnStealWork(ranges[(self + v) % nthreads], ranges[self], index);
+			}
+			if(!found) return; // every range is empty: nothing left to do
+			work(index);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(nthreads - 1);
+	for(size_t t = 1; t < nthreads; ++t) {
+		threads.emplace_back(worker, t);
+	}
+	worker(0);
+	for(auto& thread : threads) {
+		thread.join();
+	}
+}
+
+unsigned WlnDefaultJobs() {
+	unsigned n = std::thread::hardware_concurrency();
+	return n ? n : 1;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// WlnParallelFor calls work(i) for every i in [0, count) on up to jobs threads
+// (the calling thread included) and returns once all of them have finished.
+//
+// Each thread starts with a contiguous run of indices and works through it in
+// ascending order; a thread that runs dry steals the back half of another
+// thread's remaining run. work must not throw.
+void WlnParallelFor(size_t count, unsigned jobs, const std::function<void(size_t)>& work);
+
+// WlnDefaultJobs returns the number of threads to use for --jobs=0.
+unsigned WlnDefaultJobs();
@@ -0,0 +1,92 @@
+#include "common.h"
+#include "utf8.h"
+
+#ifdef _WIN32
+bool WlnUtf8ToWide(const char* in, size_t inlen, std::wstring& out) {
+	out.clear();
+	if(!inlen) return true;
+
+	int len = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, in, static_cast<int>(inlen), nullptr, 0);
+	if(!len) return false;
+	out.resize(len);
+	MultiByteToWideChar(CP_UTF8, 0, in, static_cast<int>(inlen), &out[0], len);
+	return true;
+}
+
+bool WlnWideToUtf8(const wchar_t* in, size_t inlen, std::string& out) {
+	out.clear();
+	if(!inlen) return true;
+
+	int len = WideCharToMultiByte(CP_UTF8, WC_ERR_INVALID_CHARS, in, static_cast<int>(inlen), nullptr, 0, nullptr, nullptr);
+	if(!len) return false;
+	out.resize(len);
+	WideCharToMultiByte(CP_UTF8, 0, in, static_cast<int>(inlen), &out[0], len, nullptr, nullptr);
+	return true;
+}
+#else
+bool WlnUtf8ToWide(const char* in, size_t inlen, std::wstring& out) {
+	out.clear();
+	out.reserve(inlen);
+
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(in);
+	const unsigned char* end = p + inlen;
+	while(p < end) {
+		char32_t c = *p++;
+		int extra = 0;
+		if(c < 0x80) {
+			extra = 0;
+		} else if((c & 0xE0) == 0xC0) {
+			c &= 0x1F;
+			extra = 1;
+		} else if((c & 0xF0) == 0xE0) {
+			c &= 0x0F;
+			extra = 2;
+		} else if((c & 0xF8) == 0xF0) {
+			c &= 0x07;
+			extra = 3;
+		} else {
+			return false;
+		}
+
+		if(end - p < extra) return false;
+		for(int i = 0; i < extra; ++i) {
+			if((*p & 0xC0) != 0x80) return false;
+			c = (c << 6) | (*p++ & 0x3F);
+		}
+
+		// reject overlong forms, surrogates and anything past U+10FFFF
+		static const char32_t minimum[]{0, 0x80, 0x800, 0x10000};
+		if(c < minimum[extra] || (c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF) return false;
+		out.push_back(static_cast<wchar_t>(c));
+	}
+	return true;
+}
+
+bool WlnWideToUtf8(const wchar_t* in, size_t inlen, std::string& out) {
+	out.clear();
+	out.reserve(inlen);
+
+	for(size_t i = 0; i < inlen; ++i) {
+		char32_t c = static_cast<char32_t>(in[i]);
+		if(c < 0x80) {
+			out.push_back(static_cast<char>(c));
+		} else if(c < 0x800) {
+			out.push_back(static_cast<char>(0xC0 | (c >> 6)));
+			out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+		} else if(c < 0x10000) {
+			if(c >= 0xD800 && c <= 0xDFFF) return false;
+			out.push_back(static_cast<char>(0xE0 | (c >> 12)));
+			out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+			out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+		} else if(c <= 0x10FFFF) {
+			out.push_back(static_cast<char>(0xF0 | (c >> 18)));
+			out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+			out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+			out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+#endif
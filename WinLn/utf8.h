@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+
+// Conversions between UTF-8 and the platform's wchar_t encoding (UTF-16 on
+// Windows, UTF-32 elsewhere). Both return false on malformed input.
+bool WlnUtf8ToWide(const char* in, size_t inlen, std::wstring& out);
+bool WlnWideToUtf8(const wchar_t* in, size_t inlen, std::string& out);
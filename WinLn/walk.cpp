@@ -0,0 +1,61 @@
+#include "walk.h"
+#include "error.h"
+
+#include <algorithm>
+#include <vector>
+
+static bool WlnIsPhysicalDirectory(const WlnFileInfo& info) {
+	return (info.attributes & WlnFileAttributeDirectory) && !(info.attributes & WlnFileAttributeReparsePoint);
+}
+
+void WlnWalkTree(const std::wstring& root, uint32_t needs, const std::function<void(const WlnWalkEntry&)>& visit) {
+	// Directories still to read, as paths relative to root; depth first, so
+	// only one branch's worth is ever waiting.
+	std::vector<std::wstring> pending{std::wstring{}};
+	std::wstring base{root};
+	if(base.empty() || base.back() != WLN_PATH_SEPARATOR) {
+		base += WLN_PATH_SEPARATOR;
+	}
+
+	WlnFsDirectoryReader reader;
+	WlnFsDirectoryEntry entry;
+	std::wstring path;
+	while(!pending.empty()) {
+		std::wstring relativeDir{std::move(pending.back())};
+		pending.pop_back();
+
+		WlnFsDirectory dir;
+		std::wstring dirPath{base + relativeDir};
+		if(int err = dir.open(dirPath)) {
+			if(WlnFsIsNotFound(err) && !relativeDir.empty()) continue;
+			WlnAbortWithSystemError(err, L"Failed to open directory `%ls'.", dirPath.c_str());
+		}
+		if(int err = reader.open(dir)) {
+			WlnAbortWithSystemError(err, L"Failed to read directory `%ls'.", dirPath.c_str());
+		}
+
+		size_t firstChild = pending.size();
+		while(reader.next(entry)) {
+			bool complete = (entry.known & WlnFsEntryAttributes) && (WlnIsPhysicalDirectory(entry.info) || (entry.known & needs) == needs);
+			if(!complete) {
+				if(int err = WlnFsQueryFileInfo(&dir, entry.name, entry.info)) {
+					if(WlnFsIsNotFound(err)) continue;
+					WlnAbortWithSystemError(err, L"Failed to read attributes for `%ls%ls'.", dir.path().c_str(), entry.name.c_str());
+				}
+			}
+
+			path.assign(dir.path());
+			path += entry.name;
+			visit(WlnWalkEntry{path, std::wstring_view{path}.substr(base.size()), dir, entry.name, entry.info});
+
+			if(WlnIsPhysicalDirectory(entry.info)) {
+				pending.push_back(relativeDir + entry.name + WLN_PATH_SEPARATOR);
+			}
+		}
+		if(reader.error()) {
+			WlnAbortWithSystemError(reader.error(), L"Failed to read directory `%ls'.", dirPath.c_str());
+		}
+		// Visit subdirectories in the order they were listed.
+		std::reverse(pending.begin() + firstChild, pending.end());
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "fs.h"
+
+#include <functional>
+#include <string>
+
+// WlnWalkEntry is one file or directory found by WlnWalkTree.
+struct WlnWalkEntry {
+	const std::wstring& path; // root joined with relative
+	std::wstring_view relative; // the path below root
+	const WlnFsDirectory& dir; // the open directory it's in
+	const std::wstring& name; // its leaf name in dir
+	const WlnFileInfo& info; // about the entry itself; links aren't followed
+};
+
+// WlnWalkTree calls visit for everything below root (an absolute, normalized
+// directory), each directory before what's in it. Directory links and
+// junctions are visited but not descended into. Files that disappear during
+// the walk are skipped; any other error aborts.
+//
+// Entries come from WlnFsDirectoryReader, and are only queried one by one
+// when the listing leaves out something needed: their attributes, or (for
+// anything but directories) the other WlnFsEntryField parts in needs. Parts
+// of info nobody asked for may be left zero.
+void WlnWalkTree(const std::wstring& root, uint32_t needs, const std::function<void(const WlnWalkEntry&)>& visit);
@@ -0,0 +1,238 @@
+#include <gtest/gtest.h>
+#include "scratchdir.h"
+#include "timing.h"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+// These run winln itself, end to end, so they need a winln to run: set the
+// WINLN environment variable to its path. Without it, they pass untried.
+
+// winlnPath returns the path in WINLN, or an empty path if it isn't set.
+static std::filesystem::path winlnPath() {
+#ifdef _WIN32
+	wchar_t* value = nullptr;
+	size_t length = 0;
+	std::filesystem::path path;
+	if(_wdupenv_s(&value, &length, L"WINLN") == 0 && value) {
+		path = value;
+	}
+	free(value);
+	return path;
+#else
+	const char* value = getenv("WINLN");
+	return value ? value : "";
+#endif
+}
+
+static std::wstring quote(const std::filesystem::path& path) {
+	return L"\"" + path.wstring() + L"\"";
+}
+
+// runCommand runs command with the shell and returns its exit status.
+static int runCommand(const std::wstring& command) {
+#ifdef _WIN32
+	// cmd takes the quotes off either end of the whole command.
+	return _wsystem((L"\"" + command + L"\"").c_str());
+#else
+	return system(std::filesystem::path{command}.string().c_str());
+#endif
+}
+
+static size_t countEntries(const std::filesystem::path& path) {
+	return std::distance(std::filesystem::recursive_directory_iterator{path}, std::filesystem::recursive_directory_iterator{});
+}
+
+// writeManifest writes records (target, link) to a manifest at path.
+static void writeManifest(const std::filesystem::path& path, const std::vector<std::pair<std::filesystem::path, std::filesystem::path>>& records) {
+	std::ofstream out{path, std::ios::binary};
+	for(auto& record : records) {
+		out << record.first.string() << '\t' << record.second.string() << '\n';
+	}
+}
+
+static std::vector<std::string> readLines(const std::filesystem::path& path) {
+	std::ifstream in{path, std::ios::binary};
+	std::vector<std::string> lines;
+	for(std::string line; std::getline(in, line);) {
+		lines.push_back(line);
+	}
+	return lines;
+}
+
+// Links are made a directory at a time, but reported in manifest order.
+TEST(ManifestTest, ReportsLinksInRecordOrder) {
+	auto winln{winlnPath()};
+	if(winln.empty()) {
+		SUCCEED() << "WINLN isn't set";
+		return;
+	}
+	scratchdir scratch;
+	std::filesystem::path target{scratch.file(L"target", "target")};
+	std::filesystem::create_directory(scratch.path / L"d1");
+	std::filesystem::create_directory(scratch.path / L"d2");
+	auto manifest{scratch.path / L"manifest.txt"};
+	writeManifest(manifest, {
+		{target, scratch.path / L"d1" / L"link-a"},
+		{target, scratch.path / L"d2" / L"link-b"},
+		{target, scratch.path / L"d1" / L"link-c"},
+	});
+	auto output{scratch.path / L"output.jsonl"};
+
+	ASSERT_EQ(0, runCommand(quote(winln) + L" --jobs=4 --output=jsonl --from-file=" + quote(manifest) + L" > " + quote(output)));
+	auto lines{readLines(output)};
+	ASSERT_EQ(3u, lines.size());
+	EXPECT_NE(std::string::npos, lines[0].find("link-a"));
+	EXPECT_NE(std::string::npos, lines[1].find("link-b"));
+	EXPECT_NE(std::string::npos, lines[2].find("link-c"));
+}
+
+// A record can link to the link an earlier one made.
+TEST(ManifestTest, FollowsChainedRecords) {
+	auto winln{winlnPath()};
+	if(winln.empty()) {
+		SUCCEED() << "WINLN isn't set";
+		return;
+	}
+	scratchdir scratch;
+	std::filesystem::path a{scratch.file(L"a", "a")};
+	auto manifest{scratch.path / L"manifest.txt"};
+	writeManifest(manifest, {
+		{a, scratch.path / L"b"},
+		{scratch.path / L"b", scratch.path / L"c"},
+	});
+
+	ASSERT_EQ(0, runCommand(quote(winln) + L" --from-file=" + quote(manifest)));
+	EXPECT_TRUE(std::filesystem::equivalent(a, scratch.path / L"c"));
+}
+
+// With -f, a link name given again is replaced, just as by separate runs.
+TEST(ManifestTest, ReplacesRepeatedLinksWithForce) {
+	auto winln{winlnPath()};
+	if(winln.empty()) {
+		SUCCEED() << "WINLN isn't set";
+		return;
+	}
+	scratchdir scratch;
+	std::filesystem::path t{scratch.file(L"t", "t")};
+	std::filesystem::path u{scratch.file(L"u", "u")};
+	auto manifest{scratch.path / L"manifest.txt"};
+	writeManifest(manifest, {
+		{t, scratch.path / L"l"},
+		{u, scratch.path / L"l"},
+	});
+
+	ASSERT_EQ(0, runCommand(quote(winln) + L" -f --from-file=" + quote(manifest)));
+	EXPECT_TRUE(std::filesystem::equivalent(u, scratch.path / L"l"));
+}
+
+// --from-file makes every link in one process, so it has to beat starting
+// winln once for each.
+TEST(ManifestTimingTest, BeatsOneProcessPerLink) {
+	auto winln{winlnPath()};
+	if(winln.empty()) {
+		SUCCEED() << "WINLN isn't set";
+		return;
+	}
+	constexpr int linkCount = 200;
+	scratchdir scratch;
+	std::filesystem::path target{scratch.file(L"target", "target")};
+	auto separate{scratch.path / L"separate"};
+	auto batched{scratch.path / L"batched"};
+	std::filesystem::create_directory(separate);
+	std::filesystem::create_directory(batched);
+	auto manifest{scratch.path / L"manifest.txt"};
+	std::vector<std::pair<std::filesystem::path, std::filesystem::path>> records;
+	for(int i = 0; i < linkCount; ++i) {
+		records.emplace_back(target, batched / (L"link" + std::to_wstring(i)));
+	}
+	writeManifest(manifest, records);
+
+	double separateTime = timeMilliseconds([&]() {
+		for(int i = 0; i < linkCount; ++i) {
+			EXPECT_EQ(0, runCommand(quote(winln) + L" " + quote(target) + L" " + quote(separate / (L"link" + std::to_wstring(i)))));
+		}
+	});
+	double batchedTime = timeMilliseconds([&]() {
+		EXPECT_EQ(0, runCommand(quote(winln) + L" --from-file=" + quote(manifest)));
+	});
+
+	EXPECT_EQ(static_cast<size_t>(linkCount), countEntries(separate));
+	EXPECT_EQ(static_cast<size_t>(linkCount), countEntries(batched));
+	reportTiming(std::to_string(linkCount) + " processes", separateTime);
+	reportTiming("one manifest of " + std::to_string(linkCount), batchedTime);
+	EXPECT_LT(batchedTime, separateTime);
+}
+
+// --jobs makes links on a pool of threads. This times one manifest of 100,000
+// links into a single directory at 1, 4 and 16 jobs. On a local disk (or with
+// one CPU) more jobs needn't be faster, since the link calls are all there is
+// to it; where each call waits on a network share, they are.
+TEST(ParallelLinkTimingTest, CreatesLinksAtEachJobCount) {
+	auto winln{winlnPath()};
+	if(winln.empty()) {
+		SUCCEED() << "WINLN isn't set";
+		return;
+	}
+	constexpr size_t linkCount = 100000;
+	constexpr size_t targetCount = 1000; // a file can only have so many hard links
+	scratchdir scratch;
+	std::vector<std::filesystem::path> targets;
+	for(size_t i = 0; i < targetCount; ++i) {
+		targets.push_back(scratch.file((L"targets/" + std::to_wstring(i)).c_str(), "target"));
+	}
+
+	for(unsigned jobs : {1u, 4u, 16u}) {
+		auto path{scratch.path / (L"jobs" + std::to_wstring(jobs))};
+		std::filesystem::create_directory(path);
+		auto manifest{scratch.path / (L"jobs" + std::to_wstring(jobs) + L".txt")};
+		std::vector<std::pair<std::filesystem::path, std::filesystem::path>> records;
+		for(size_t i = 0; i < linkCount; ++i) {
+			records.emplace_back(targets[i % targetCount], path / (L"link" + std::to_wstring(i)));
+		}
+		writeManifest(manifest, records);
+
+		double elapsed = timeMilliseconds([&]() {
+			EXPECT_EQ(0, runCommand(quote(winln) + L" --jobs=" + std::to_wstring(jobs) + L" --from-file=" + quote(manifest))) << jobs << " jobs";
+		});
+		EXPECT_EQ(linkCount, countEntries(path)) << jobs << " jobs";
+		reportTiming(std::to_string(linkCount) + " links, " + std::to_string(jobs) + " jobs", elapsed);
+	}
+}
+
+// --recursive mirrors a tree in one process. This times it on a wide tree
+// (one directory of 20,000 files) and a deep one (50 nested directories of
+// 100 files each), and checks that every entry was mirrored.
+TEST(RecursiveTimingTest, MirrorsWideAndDeepTrees) {
+	auto winln{winlnPath()};
+	if(winln.empty()) {
+		SUCCEED() << "WINLN isn't set";
+		return;
+	}
+	scratchdir scratch;
+	for(int i = 0; i < 20000; ++i) {
+		scratch.file((L"wide/file" + std::to_wstring(i)).c_str(), "wide");
+	}
+	std::wstring level{L"deep"};
+	for(int d = 0; d < 50; ++d) {
+		level += L"/d";
+		for(int i = 0; i < 100; ++i) {
+			scratch.file((level + L"/file" + std::to_wstring(i)).c_str(), "deep");
+		}
+	}
+
+	for(const wchar_t* shape : {L"wide", L"deep"}) {
+		auto source{scratch.path / shape};
+		auto mirror{scratch.path / (std::wstring{shape} + L"-mirror")};
+		double elapsed = timeMilliseconds([&]() {
+			EXPECT_EQ(0, runCommand(quote(winln) + L" --recursive " + quote(source) + L" " + quote(mirror)));
+		});
+		size_t entries = countEntries(source);
+		EXPECT_EQ(entries, countEntries(mirror));
+		reportTiming(std::filesystem::path{shape}.string() + " tree of " + std::to_string(entries) + " entries", elapsed);
+	}
+}
@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+#include <WinLn/dedupe.h>
+#include "scratchdir.h"
+#include "timing.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+TEST(DedupeTest, FindsFilesWithTheSameContents) {
+	scratchdir scratch;
+	auto first = scratch.file(L"a", "same");
+	auto second = scratch.file(L"sub/b", "same");
+	scratch.file(L"c", "diff"); // same size, different contents
+	scratch.file(L"d", "different");
+	scratch.file(L"e", "");
+	scratch.file(L"f", "");
+
+	auto duplicates{WlnFindDuplicates(scratch.path.wstring(), 2)};
+	ASSERT_EQ(1u, duplicates.size());
+	// whichever the walk finds first is kept
+	EXPECT_TRUE((duplicates[0].original == first && duplicates[0].duplicate == second) || (duplicates[0].original == second && duplicates[0].duplicate == first));
+}
+
+TEST(DedupeTest, SkipsFilesThatAreAlreadyLinked) {
+	scratchdir scratch;
+	auto original = scratch.file(L"a", "same");
+	std::filesystem::create_hard_link(original, scratch.path / L"b");
+
+	EXPECT_TRUE(WlnFindDuplicates(scratch.path.wstring(), 1).empty());
+}
+
+// A duplicate with several names needs every one of them relinked.
+TEST(DedupeTest, ReportsEveryNameOfADuplicate) {
+	scratchdir scratch;
+	scratch.file(L"a", "same");
+	auto other = scratch.file(L"b", "same");
+	std::filesystem::create_hard_link(other, scratch.path / L"c");
+
+	auto duplicates{WlnFindDuplicates(scratch.path.wstring(), 1)};
+	std::vector<std::wstring> names;
+	for(auto& d : duplicates) {
+		names.push_back(d.duplicate);
+	}
+	std::sort(names.begin(), names.end());
+	if(names.size() == 1) {
+		// the walk found b or c first, and a is the duplicate
+		EXPECT_EQ((scratch.path / L"a").wstring(), names[0]);
+	} else {
+		EXPECT_EQ((std::vector<std::wstring>{(scratch.path / L"b").wstring(), (scratch.path / L"c").wstring()}), names);
+	}
+}
+
+// A synthetic tree of 2000 files of the same size (so every one is hashed),
+// a quarter of them copies of others: it times the search, and checks that
+// it finds exactly the copies.
+TEST(DedupeTimingTest, FindsAKnownShareOfDuplicates) {
+	constexpr int fileCount = 2000;
+	constexpr int uniqueCount = 1500;
+	constexpr size_t fileSize = 16 * 1024;
+	scratchdir scratch;
+	std::string contents(fileSize, '\0');
+	for(int i = 0; i < fileCount; ++i) {
+		std::mt19937 rng{static_cast<unsigned>(i % uniqueCount)};
+		std::generate(contents.begin(), contents.end(), [&]() { return static_cast<char>(rng()); });
+		auto dir{scratch.path / ("dir" + std::to_string(i % 20))};
+		std::filesystem::create_directories(dir);
+		std::ofstream{dir / ("file" + std::to_string(i)), std::ios::binary} << contents;
+	}
+
+	std::vector<WlnDuplicate> duplicates;
+	double elapsed = timeMilliseconds([&]() {
+		duplicates = WlnFindDuplicates(scratch.path.wstring(), 4);
+	});
+
+	EXPECT_EQ(static_cast<size_t>(fileCount - uniqueCount), duplicates.size());
+	reportTiming("2000 files of 16 KiB, 500 duplicates, 4 jobs", elapsed);
+}
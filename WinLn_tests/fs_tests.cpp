@@ -0,0 +1,193 @@
+#include <gtest/gtest.h>
+#include <WinLn/fs.h>
+#include "scratchdir.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class linkkind {
+	Hard,
+	Symbolic,
+};
+
+class AtomicReplaceTest: public ::testing::TestWithParam<linkkind> {
+protected:
+	static int create(linkkind kind, const WlnFsDirectory& dir, const std::wstring& name, const std::wstring& target) {
+		if(kind == linkkind::Hard) {
+			return WlnFsCreateHardLink(&dir, name, target);
+		}
+		return WlnFsCreateSymbolicLink(&dir, name, target, false);
+	}
+};
+
+// Swap the link between two targets thousands of times (the way --atomic
+// does: create beside it, rename over it) while readers keep opening it.
+// None of them may ever find it missing.
+TEST_P(AtomicReplaceTest, ReadersNeverSeeTheLinkMissing) {
+	scratchdir scratch;
+	std::wstring targets[]{scratch.file(L"a", "a"), scratch.file(L"b", "b")};
+
+	WlnFsDirectory dir;
+	ASSERT_EQ(0, dir.open(scratch.path.wstring()));
+	if(create(GetParam(), dir, L"link", targets[0]) != 0) {
+		// Windows only lets Developer Mode or elevated users create symbolic links.
+		ASSERT_EQ(linkkind::Symbolic, GetParam());
+		SUCCEED() << "symbolic links aren't available to this user";
+		return;
+	}
+
+	std::atomic<bool> done{false};
+	std::atomic<size_t> reads{0}, missing{0};
+	std::vector<std::thread> readers;
+	for(int i = 0; i < 4; ++i) {
+		readers.emplace_back([&]() {
+			WlnFileInfo info;
+			std::wstring contents;
+			while(!done.load()) {
+				int err = GetParam() == linkkind::Hard ? WlnFsQueryFileInfo(&dir, L"link", info) : WlnFsReadLink(&dir, L"link", contents);
+				if(err) ++missing;
+				++reads;
+			}
+		});
+	}
+
+	int failures = 0;
+	for(int i = 1; i <= 5000 && failures == 0; ++i) {
+		if(create(GetParam(), dir, L"link.tmp", targets[i % 2]) != 0 || WlnFsRename(&dir, L"link.tmp", L"link") != 0) {
+			++failures;
+		}
+	}
+	done = true;
+	for(auto& reader : readers) {
+		reader.join();
+	}
+
+	EXPECT_EQ(0, failures);
+	EXPECT_GT(reads.load(), 0u);
+	EXPECT_EQ(0u, missing.load());
+
+	// the last swap (an even one) put it back on a
+	if(GetParam() == linkkind::Hard) {
+		WlnFileInfo link, a;
+		ASSERT_EQ(0, WlnFsQueryFileInfo(&dir, L"a", a));
+		ASSERT_EQ(0, WlnFsQueryFileInfo(&dir, L"link", link));
+		EXPECT_EQ(0, memcmp(&link.id, &a.id, sizeof(a.id)));
+	} else {
+		std::wstring contents;
+		ASSERT_EQ(0, WlnFsReadLink(&dir, L"link", contents));
+		EXPECT_EQ(targets[0], contents);
+	}
+}
+
+INSTANTIATE_TEST_CASE_P(Fs, AtomicReplaceTest, ::testing::Values(linkkind::Hard, linkkind::Symbolic));
+
+TEST(RenameTest, ReplacesExistingFile) {
+	scratchdir scratch;
+	scratch.file(L"from", "new");
+	scratch.file(L"to", "old");
+
+	WlnFsDirectory dir;
+	ASSERT_EQ(0, dir.open(scratch.path.wstring()));
+	ASSERT_EQ(0, WlnFsRename(&dir, L"from", L"to"));
+
+	std::string contents;
+	std::ifstream{scratch.path / L"to"} >> contents;
+	EXPECT_EQ("new", contents);
+	EXPECT_FALSE(std::filesystem::exists(scratch.path / L"from"));
+}
+
+// Opening a directory object again lets go of the first directory.
+TEST(DirectoryTest, OpensAnotherDirectory) {
+	scratchdir scratch;
+	scratch.file(L"a/only_a", "a");
+	scratch.file(L"b/only_b", "b");
+
+	WlnFsDirectory dir;
+	ASSERT_EQ(0, dir.open((scratch.path / L"a").wstring()));
+	ASSERT_EQ(0, dir.open((scratch.path / L"b").wstring()));
+
+	WlnFileInfo info;
+	EXPECT_EQ(0, WlnFsQueryFileInfo(&dir, L"only_b", info));
+	EXPECT_TRUE(WlnFsIsNotFound(WlnFsQueryFileInfo(&dir, L"only_a", info)));
+}
+
+// Whatever the listing says about an entry must agree with querying it.
+TEST(DirectoryReaderTest, AgreesWithQueryFileInfo) {
+	scratchdir scratch;
+	scratch.file(L"a", "a");
+	scratch.file(L"bb", "bb");
+	std::filesystem::create_directory(scratch.path / L"c");
+
+	WlnFsDirectory dir;
+	ASSERT_EQ(0, dir.open(scratch.path.wstring()));
+	WlnFsDirectoryReader reader;
+	for(int pass = 0; pass < 2; ++pass) {
+		ASSERT_EQ(0, reader.open(dir));
+		std::vector<std::wstring> names;
+		WlnFsDirectoryEntry entry;
+		while(reader.next(entry)) {
+			names.push_back(entry.name);
+
+			WlnFileInfo info;
+			ASSERT_EQ(0, WlnFsQueryFileInfo(&dir, entry.name, info));
+			if(entry.known & WlnFsEntryAttributes) {
+				EXPECT_EQ(info.attributes, entry.info.attributes);
+				EXPECT_EQ(info.reparseTag, entry.info.reparseTag);
+			}
+			if(entry.known & WlnFsEntryID) {
+				EXPECT_EQ(0, memcmp(&info.id, &entry.info.id, sizeof(info.id)));
+			}
+			if((entry.known & WlnFsEntrySize) && !(info.attributes & WlnFileAttributeDirectory)) {
+				EXPECT_EQ(info.size, entry.info.size);
+			}
+		}
+		EXPECT_EQ(0, reader.error());
+
+		// a reader can start again from the top
+		std::sort(names.begin(), names.end());
+		EXPECT_EQ((std::vector<std::wstring>{L"a", L"bb", L"c"}), names);
+	}
+}
+
+// Big directories take more than one batch.
+TEST(DirectoryReaderTest, ReadsPastTheFirstBatch) {
+	scratchdir scratch;
+	std::wstring name(100, L'x');
+	for(int i = 0; i < 2000; ++i) {
+		std::ofstream{scratch.path / (name + std::to_wstring(i))};
+	}
+
+	WlnFsDirectory dir;
+	ASSERT_EQ(0, dir.open(scratch.path.wstring()));
+	WlnFsDirectoryReader reader;
+	ASSERT_EQ(0, reader.open(dir));
+	size_t count = 0;
+	WlnFsDirectoryEntry entry;
+	while(reader.next(entry)) {
+		++count;
+	}
+	EXPECT_EQ(0, reader.error());
+	EXPECT_EQ(2000u, count);
+}
+
+TEST(MappedFileTest, MapsTheWholeFile) {
+	scratchdir scratch;
+	scratch.file(L"full", "contents");
+	scratch.file(L"empty", "");
+
+	WlnFsDirectory dir;
+	ASSERT_EQ(0, dir.open(scratch.path.wstring()));
+	WlnFsMappedFile full, empty;
+	ASSERT_EQ(0, full.open(&dir, L"full"));
+	EXPECT_EQ("contents", std::string(reinterpret_cast<const char*>(full.data()), full.size()));
+	ASSERT_EQ(0, empty.open(&dir, L"empty"));
+	EXPECT_EQ(0u, empty.size());
+
+	WlnFsMappedFile missing;
+	EXPECT_TRUE(WlnFsIsNotFound(missing.open(&dir, L"missing")));
+}
@@ -0,0 +1,44 @@
+#include <gtest/gtest.h>
+#include <WinLn/hash.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct hashcase {
+	const char* input;
+	uint64_t expected;
+};
+
+class HashTest: public ::testing::TestWithParam<struct hashcase> {
+};
+
+TEST_P(HashTest, MatchesXXH64) {
+	auto& testcase = GetParam();
+	EXPECT_EQ(testcase.expected, WlnHash(testcase.input, strlen(testcase.input)));
+}
+
+struct hashcase hashCases[]{
+	{"", 0xEF46DB3751D8E999ULL},
+	{"a", 0xD24EC4F1A98C6E5BULL},
+	{"abc", 0x44BC2CF5AD770999ULL},
+	{"Nobody inspects the spammish repetition", 0xFBCEA83C8A378BF1ULL},
+};
+
+INSTANTIATE_TEST_CASE_P(Hash, HashTest, ::testing::ValuesIn(hashCases));
+
+// However the input is split up, the result is the same as hashing it whole.
+TEST(HasherTest, DoesntCareHowItIsFed) {
+	std::vector<uint8_t> data(1000);
+	for(size_t i = 0; i < data.size(); ++i) {
+		data[i] = static_cast<uint8_t>(i * 7 + 3);
+	}
+	uint64_t whole = WlnHash(data.data(), data.size());
+
+	for(size_t piece : {1, 3, 31, 32, 33, 64, 999}) {
+		WlnHasher hasher;
+		for(size_t offset = 0; offset < data.size(); offset += piece) {
+			hasher.update(data.data() + offset, std::min(piece, data.size() - offset));
+		}
+		EXPECT_EQ(whole, hasher.finish()) << "pieces of " << piece;
+	}
+}
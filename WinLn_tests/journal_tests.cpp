@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+#include <WinLn/journal.h>
+#include "scratchdir.h"
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+static std::vector<WlnJournalRecord> sampleRecords() {
+	return {
+		{WlnJournalOp::CreatedDirectory, L"/d", L""},
+		{WlnJournalOp::Displaced, L"/d/café", L"/d/.café.winln-1-0"},
+		{WlnJournalOp::CreatedLink, L"/d/\U0001F517", L""},
+	};
+}
+
+static void expectSameRecords(const std::vector<WlnJournalRecord>& expected, const std::vector<WlnJournalRecord>& actual) {
+	ASSERT_EQ(expected.size(), actual.size());
+	for(size_t i = 0; i < expected.size(); ++i) {
+		EXPECT_EQ(expected[i].op, actual[i].op) << "record " << i;
+		EXPECT_EQ(expected[i].path, actual[i].path) << "record " << i;
+		EXPECT_EQ(expected[i].backup, actual[i].backup) << "record " << i;
+	}
+}
+
+TEST(JournalTest, ParsesWhatItAppends) {
+	std::string encoded;
+	for(auto& record : sampleRecords()) {
+		ASSERT_TRUE(WlnAppendJournalRecord(encoded, record));
+	}
+
+	std::vector<WlnJournalRecord> records;
+	ASSERT_TRUE(WlnParseJournal(encoded.data(), encoded.size(), records));
+	expectSameRecords(sampleRecords(), records);
+}
+
+// A crash can stop a write anywhere; whatever whole records came before it
+// must still be read back.
+TEST(JournalTest, IgnoresATruncatedLastRecord) {
+	auto sample{sampleRecords()};
+	std::string encoded;
+	std::vector<size_t> ends;
+	for(auto& record : sample) {
+		ASSERT_TRUE(WlnAppendJournalRecord(encoded, record));
+		ends.push_back(encoded.size());
+	}
+
+	for(size_t length = 0; length <= encoded.size(); ++length) {
+		std::vector<WlnJournalRecord> records;
+		ASSERT_TRUE(WlnParseJournal(encoded.data(), length, records)) << "length " << length;
+		size_t whole = 0;
+		while(whole < ends.size() && ends[whole] <= length) ++whole;
+		expectSameRecords({sample.begin(), sample.begin() + whole}, records);
+	}
+}
+
+TEST(JournalTest, RejectsUnknownOperations) {
+	std::string encoded{"L/a", 4};
+	encoded += std::string{"X/b", 4};
+
+	std::vector<WlnJournalRecord> records;
+	EXPECT_FALSE(WlnParseJournal(encoded.data(), encoded.size(), records));
+}
+
+// Everything recorded is on disk once the journal is closed, and a journal
+// that's there already is never overwritten.
+TEST(JournalTest, ReadsBackWhatWasRecorded) {
+	scratchdir scratch;
+	std::wstring path{(scratch.path / L"journal").wstring()};
+
+	std::vector<WlnJournalRecord> expected;
+	{
+		WlnJournal journal;
+		ASSERT_EQ(0, journal.create(path));
+		for(size_t i = 0; i < WlnJournalGroupSize + 10; ++i) {
+			WlnJournalRecord record{WlnJournalOp::CreatedLink, L"/link" + std::to_wstring(i), L""};
+			expected.push_back(record);
+			ASSERT_EQ(0, journal.record(record));
+		}
+		ASSERT_EQ(0, journal.close());
+		expectSameRecords(expected, journal.records());
+
+		WlnJournal again;
+		EXPECT_NE(0, again.create(path));
+	}
+
+	std::vector<WlnJournalRecord> records;
+	ASSERT_EQ(0, WlnReadJournal(path, records));
+	expectSameRecords(expected, records);
+
+	expected.resize(1);
+	ASSERT_EQ(0, WlnWriteJournal(path, expected));
+	ASSERT_EQ(0, WlnReadJournal(path, records));
+	expectSameRecords(expected, records);
+}
+
+// Each record is handed to the system as soon as it's made, before the
+// change it names, so it's there even if the program dies without closing.
+TEST(JournalTest, WritesEachRecordStraightAway) {
+	scratchdir scratch;
+	std::wstring path{(scratch.path / L"journal").wstring()};
+
+	WlnJournal journal;
+	ASSERT_EQ(0, journal.create(path));
+	auto sample{sampleRecords()};
+	for(size_t i = 0; i < sample.size(); ++i) {
+		ASSERT_EQ(0, journal.record(sample[i]));
+		std::vector<WlnJournalRecord> records;
+		ASSERT_EQ(0, WlnReadJournal(path, records));
+		expectSameRecords({sample.begin(), sample.begin() + i + 1}, records);
+	}
+}
+
+// A change that failed is taken back out, so that a rollback leaves alone
+// whatever is at its path; the change before it to the same path stays.
+TEST(JournalTest, LeavesOutCancelledChanges) {
+	scratchdir scratch;
+	std::wstring path{(scratch.path / L"journal").wstring()};
+	std::vector<WlnJournalRecord> expected{
+		{WlnJournalOp::Displaced, L"/d/l", L"/d/.l.winln-1-0"},
+		{WlnJournalOp::CreatedLink, L"/d/m", L""},
+	};
+
+	{
+		WlnJournal journal;
+		ASSERT_EQ(0, journal.create(path));
+		ASSERT_EQ(0, journal.record(expected[0]));
+		ASSERT_EQ(0, journal.record({WlnJournalOp::CreatedLink, L"/d/l", L""}));
+		ASSERT_EQ(0, journal.record(expected[1]));
+		ASSERT_EQ(0, journal.record({WlnJournalOp::Cancelled, L"/d/l", L""}));
+		ASSERT_EQ(0, journal.close());
+		expectSameRecords(expected, journal.records());
+	}
+
+	std::vector<WlnJournalRecord> records;
+	ASSERT_EQ(0, WlnReadJournal(path, records));
+	expectSameRecords(expected, records);
+}
+
+TEST(JournalTest, UndoesEachKindOfChange) {
+	scratchdir scratch;
+	std::wstring link{scratch.file(L"link", "new")};
+	std::wstring backup{scratch.file(L"backup", "old")};
+	std::wstring dir{(scratch.path / L"dir").wstring()};
+	std::filesystem::create_directory(dir);
+
+	EXPECT_EQ(0, WlnUndoJournalRecord({WlnJournalOp::CreatedLink, link, L""}));
+	EXPECT_EQ(0, WlnUndoJournalRecord({WlnJournalOp::Displaced, link, backup}));
+	EXPECT_EQ(0, WlnUndoJournalRecord({WlnJournalOp::CreatedDirectory, dir, L""}));
+
+	std::string contents;
+	std::ifstream{scratch.path / L"link"} >> contents;
+	EXPECT_EQ("old", contents);
+	EXPECT_FALSE(std::filesystem::exists(backup));
+	EXPECT_FALSE(std::filesystem::exists(dir));
+
+	// Undoing them again finds nothing left to do.
+	EXPECT_EQ(0, WlnUndoJournalRecord({WlnJournalOp::CreatedDirectory, dir, L""}));
+}
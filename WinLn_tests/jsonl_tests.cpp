@@ -0,0 +1,36 @@
+#include <gtest/gtest.h>
+#include <WinLn/jsonl.h>
+#include <string>
+
+struct jsonstringcase {
+	std::wstring input;
+	std::string expected;
+};
+
+class JsonStringTest: public ::testing::TestWithParam<struct jsonstringcase> {
+};
+
+TEST_P(JsonStringTest, Escapes) {
+	auto& testcase = GetParam();
+	std::string out;
+	WlnAppendJsonString(testcase.input, out);
+	EXPECT_EQ(testcase.expected, out);
+}
+
+struct jsonstringcase jsonStringCases[]{
+	{L"", "\"\""},
+	{L"C:\\dir\\file", "\"C:\\\\dir\\\\file\""},
+	{L"say \"hi\"", "\"say \\\"hi\\\"\""},
+	{L"tab\there\nnl", "\"tab\\u0009here\\u000anl\""},
+	{L"caf\u00e9 \u65e5\u672c", "\"caf\xc3\xa9 \xe6\x97\xa5\xe6\x9c\xac\""},
+	{std::wstring{L"lone "} + static_cast<wchar_t>(0xD800), "\"lone \\ud800\""},
+};
+
+INSTANTIATE_TEST_CASE_P(Strings, JsonStringTest, ::testing::ValuesIn(jsonStringCases));
+
+TEST(JsonLineTest, WritesOneRecordPerLine) {
+	WlnLinkResult result{L"dir\\link", L"target", "symbolic", WlnLinkOutcome::Failed, 5, 1234};
+	std::string out{"{}\n"};
+	WlnAppendJsonLine(result, out);
+	EXPECT_EQ("{}\n{\"link\":\"dir\\\\link\",\"target\":\"target\",\"type\":\"symbolic\",\"outcome\":\"failed\",\"error\":5,\"elapsed_us\":1234}\n", out);
+}
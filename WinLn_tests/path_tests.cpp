@@ -0,0 +1,184 @@
+#include <gtest/gtest.h>
+#include <WinLn/path.h>
+#include "timing.h"
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct normalizecase {
+	WlnPathStyle style;
+	std::wstring path;
+	std::wstring cwd;
+	std::wstring expected; // empty: needs the drive's current directory
+};
+
+class NormalizePathTest: public ::testing::TestWithParam<struct normalizecase> {
+};
+
+TEST_P(NormalizePathTest, MatchesGetFullPathName) {
+	auto& testcase = GetParam();
+	WlnPathArena arena;
+	std::wstring_view normalized;
+	auto result = WlnNormalizePath(testcase.path, testcase.cwd, testcase.style, arena, normalized);
+	if(testcase.expected.empty()) {
+		EXPECT_EQ(WlnNormalizeResult::NeedsDriveDirectory, result);
+	} else {
+		ASSERT_EQ(WlnNormalizeResult::Ok, result);
+		EXPECT_EQ(testcase.expected, normalized);
+	}
+}
+
+struct normalizecase normalizeCases[]{
+	// Windows
+	{WlnPathStyle::Windows, L"file", L"C:\\cwd", L"C:\\cwd\\file"},
+	{WlnPathStyle::Windows, L"a/./b//c", L"C:\\cwd", L"C:\\cwd\\a\\b\\c"},
+	{WlnPathStyle::Windows, L"..\\..\\..\\a", L"C:\\cwd\\x", L"C:\\a"},
+	{WlnPathStyle::Windows, L"dir\\", L"C:\\cwd", L"C:\\cwd\\dir\\"},
+	{WlnPathStyle::Windows, L"\\rooted", L"C:\\cwd", L"C:\\rooted"},
+	{WlnPathStyle::Windows, L"D:\\a\\..\\b", L"C:\\cwd", L"D:\\b"},
+	{WlnPathStyle::Windows, L"c:relative", L"C:\\cwd", L"C:\\cwd\\relative"},
+	{WlnPathStyle::Windows, L"D:relative", L"C:\\cwd", L""},
+	{WlnPathStyle::Windows, L"\\\\server\\share\\a\\..\\..\\b", L"C:\\cwd", L"\\\\server\\share\\b"},
+	{WlnPathStyle::Windows, L"\\rooted", L"\\\\server\\share\\cwd", L"\\\\server\\share\\rooted"},
+	{WlnPathStyle::Windows, L"\\\\?\\C:\\a\\..\\b", L"C:\\cwd", L"\\\\?\\C:\\a\\..\\b"},
+	{WlnPathStyle::Windows, L"\\??\\C:\\a", L"C:\\cwd", L"\\??\\C:\\a"},
+	{WlnPathStyle::Windows, L"trailing. .", L"C:\\cwd", L"C:\\cwd\\trailing"},
+	// POSIX
+	{WlnPathStyle::Posix, L"file", L"/cwd", L"/cwd/file"},
+	{WlnPathStyle::Posix, L"a/../../..//b/", L"/cwd/x", L"/b/"},
+	{WlnPathStyle::Posix, L"/abs/./path", L"/cwd", L"/abs/path"},
+	{WlnPathStyle::Posix, L"back\\slash", L"/cwd", L"/cwd/back\\slash"},
+	{WlnPathStyle::Posix, L".", L"/", L"/"},
+};
+
+INSTANTIATE_TEST_CASE_P(Path, NormalizePathTest, ::testing::ValuesIn(normalizeCases));
+
+struct relativecase {
+	WlnPathStyle style;
+	WlnPathCase pathCase;
+	std::wstring path;
+	std::wstring base;
+	std::wstring expected; // empty: no relative path exists
+};
+
+class RelativePathTest: public ::testing::TestWithParam<struct relativecase> {
+};
+
+TEST_P(RelativePathTest, ComputesRelativePath) {
+	auto& testcase = GetParam();
+	WlnPathComponents base;
+	base.assign(testcase.base, testcase.style);
+	std::wstring relative;
+	bool ok = WlnMakePathRelative(testcase.path, base, testcase.style, testcase.pathCase, relative);
+	if(testcase.expected.empty()) {
+		EXPECT_FALSE(ok);
+	} else {
+		ASSERT_TRUE(ok);
+		EXPECT_EQ(testcase.expected, relative);
+	}
+}
+
+struct relativecase relativeCases[]{
+	// Windows
+	{WlnPathStyle::Windows, WlnPathCase::Insensitive, L"C:\\a\\file", L"C:\\a\\", L"file"},
+	{WlnPathStyle::Windows, WlnPathCase::Insensitive, L"C:\\a\\b\\file", L"C:\\a\\c\\d", L"..\\..\\b\\file"},
+	{WlnPathStyle::Windows, WlnPathCase::Insensitive, L"C:\\A\\File", L"c:\\a", L"File"},
+	{WlnPathStyle::Windows, WlnPathCase::Sensitive, L"C:\\A\\File", L"c:\\a", L"..\\A\\File"},
+	{WlnPathStyle::Windows, WlnPathCase::Insensitive, L"C:\\a", L"C:\\a\\b\\c", L"..\\.."},
+	{WlnPathStyle::Windows, WlnPathCase::Insensitive, L"C:\\a", L"C:\\a", L"."},
+	{WlnPathStyle::Windows, WlnPathCase::Insensitive, L"C:\\ab\\file", L"C:\\a", L"..\\ab\\file"},
+	{WlnPathStyle::Windows, WlnPathCase::Insensitive, L"D:\\a", L"C:\\a", L""},
+	{WlnPathStyle::Windows, WlnPathCase::Insensitive, L"\\\\server\\share\\a", L"\\\\server\\share\\b", L"..\\a"},
+	{WlnPathStyle::Windows, WlnPathCase::Insensitive, L"\\\\server\\other\\a", L"\\\\server\\share\\b", L""},
+	// POSIX
+	{WlnPathStyle::Posix, WlnPathCase::Sensitive, L"/srv/app/file", L"/srv/links", L"../app/file"},
+	{WlnPathStyle::Posix, WlnPathCase::Sensitive, L"/srv/App/file", L"/srv/app", L"../App/file"},
+	{WlnPathStyle::Posix, WlnPathCase::Insensitive, L"/srv/App/file", L"/srv/app", L"file"},
+	{WlnPathStyle::Posix, WlnPathCase::Sensitive, L"/file", L"/", L"file"},
+	{WlnPathStyle::Posix, WlnPathCase::Sensitive, L"/a/b/c/d/e/f/g", L"/a/b/x/y/z", L"../../../c/d/e/f/g"},
+};
+
+INSTANTIATE_TEST_CASE_P(Path, RelativePathTest, ::testing::ValuesIn(relativeCases));
+
+// A symlink farm of 200,000 links in a deep tree, where each link directory
+// holds many links: this times splitting the directory once for all of them
+// against splitting it again for every link. The split is only part of each
+// relative path, so the difference is too small to check for.
+TEST(RelativePathTimingTest, ReusesTheSplitLinkDirectory) {
+	constexpr size_t linkCount = 200000;
+	constexpr size_t linksPerDirectory = 100;
+	std::wstring deep{L"/srv"};
+	for(int i = 0; i < 30; ++i) {
+		deep += L"/level" + std::to_wstring(i);
+	}
+	std::vector<std::wstring> targets;
+	for(size_t i = 0; i < linksPerDirectory; ++i) {
+		targets.push_back(deep + L"/builds/" + std::to_wstring(i % 7) + L"/file" + std::to_wstring(i));
+	}
+	std::vector<std::wstring> linkDirectories;
+	for(size_t i = 0; i < linkCount / linksPerDirectory; ++i) {
+		linkDirectories.push_back(deep + L"/farm/dir" + std::to_wstring(i));
+	}
+
+	WlnPathComponents base;
+	std::wstring relative;
+	size_t failures = 0;
+	double reusing = timeMilliseconds([&]() {
+		for(size_t i = 0; i < linkCount; ++i) {
+			if(i % linksPerDirectory == 0) base.assign(linkDirectories[i / linksPerDirectory], WlnPathStyle::Posix);
+			failures += !WlnMakePathRelative(targets[i % linksPerDirectory], base, WlnPathStyle::Posix, WlnPathCase::Sensitive, relative);
+		}
+	});
+	double splitting = timeMilliseconds([&]() {
+		for(size_t i = 0; i < linkCount; ++i) {
+			base.assign(linkDirectories[i / linksPerDirectory], WlnPathStyle::Posix);
+			failures += !WlnMakePathRelative(targets[i % linksPerDirectory], base, WlnPathStyle::Posix, WlnPathCase::Sensitive, relative);
+		}
+	});
+
+	EXPECT_EQ(0u, failures);
+	EXPECT_EQ(L"../../builds/1/file99", relative);
+	reportTiming("200000 links, splitting each directory once", reusing);
+	reportTiming("200000 links, splitting it for every link", splitting);
+}
+
+TEST(PathLeafTest, ReturnsFinalComponent) {
+	EXPECT_EQ(L"file", WlnPathLeaf(L"C:\\a\\file", WlnPathStyle::Windows));
+	EXPECT_EQ(L"dir", WlnPathLeaf(L"C:\\a\\dir\\", WlnPathStyle::Windows));
+	EXPECT_EQ(L"C", WlnPathLeaf(L"C:\\", WlnPathStyle::Windows));
+	EXPECT_EQ(L"file", WlnPathLeaf(L"file", WlnPathStyle::Posix));
+	EXPECT_EQ(L"b", WlnPathLeaf(L"/a/b/", WlnPathStyle::Posix));
+}
+
+// Normalizing a million typical deploy paths into one arena has to beat
+// std::filesystem, which allocates a string for every component.
+TEST(NormalizePathTimingTest, NormalizesAMillionPaths) {
+	constexpr size_t pathCount = 1000000;
+	std::vector<std::wstring> paths;
+	for(int i = 0; i < 1000; ++i) {
+		paths.push_back(L"build/out/../bin/./release/module" + std::to_wstring(i % 37) + L"//lib" + std::to_wstring(i) + L".dll");
+	}
+	const std::wstring cwd{L"C:\\deploy\\work"};
+
+	WlnPathArena arena;
+	double normalizing = timeMilliseconds([&]() {
+		for(size_t i = 0; i < pathCount; ++i) {
+			if(i % paths.size() == 0) arena.reset();
+			std::wstring_view normalized;
+			WlnNormalizePath(paths[i % paths.size()], cwd, WlnPathStyle::Windows, arena, normalized);
+		}
+	});
+	// It's slow enough that a tenth as many tell.
+	double lexical = timeMilliseconds([&]() {
+		for(size_t i = 0; i < pathCount / 10; ++i) {
+			auto normal{(std::filesystem::path{cwd} / paths[i % paths.size()]).lexically_normal()};
+		}
+	});
+
+	std::wstring_view normalized;
+	WlnNormalizePath(paths[0], cwd, WlnPathStyle::Windows, arena, normalized);
+	EXPECT_EQ(L"C:\\deploy\\work\\build\\bin\\release\\module0\\lib0.dll", normalized);
+	reportTiming("WlnNormalizePath, 1000000 paths", normalizing);
+	reportTiming("std::filesystem, 100000 paths", lexical);
+	EXPECT_LT(normalizing, lexical * 10);
+}
@@ -0,0 +1,204 @@
+#include <gtest/gtest.h>
+#include <WinLn/reparse.h>
+#include "timing.h"
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+struct reparsecase {
+	uint32_t tag;
+	std::wstring substituteName;
+	std::wstring printName;
+	uint32_t flags;
+};
+
+class ReparseRoundTripTest: public ::testing::TestWithParam<struct reparsecase> {
+};
+
+TEST_P(ReparseRoundTripTest, ParsesWhatItBuilds) {
+	auto& testcase = GetParam();
+	std::vector<uint8_t> buffer;
+	ASSERT_TRUE(WlnBuildReparseBuffer(testcase.tag, testcase.substituteName, testcase.printName, testcase.flags, buffer));
+
+	WlnReparseData data;
+	ASSERT_TRUE(WlnParseReparseBuffer(buffer.data(), buffer.size(), data));
+	EXPECT_EQ(testcase.tag, data.tag);
+	EXPECT_EQ(testcase.substituteName, data.substituteName);
+	EXPECT_EQ(testcase.printName, data.printName);
+	EXPECT_EQ(testcase.flags, data.flags);
+}
+
+struct reparsecase reparseCases[]{
+	{WlnReparseTagMountPoint, L"\\??\\C:\\target", L"C:\\target", 0},
+	{WlnReparseTagMountPoint, L"\\??\\C:\\target", L"", 0},
+	{WlnReparseTagSymlink, L"\\??\\C:\\target", L"C:\\target", 0},
+	{WlnReparseTagSymlink, L"..\\target", L"..\\target", WlnReparseSymlinkRelative},
+	{WlnReparseTagSymlink, L"caf\u00e9\\\U0001F517", L"caf\u00e9\\\U0001F517", WlnReparseSymlinkRelative},
+};
+
+INSTANTIATE_TEST_CASE_P(Reparse, ReparseRoundTripTest, ::testing::ValuesIn(reparseCases));
+
+TEST(ReparseBufferTest, MatchesMountPointLayout) {
+	std::vector<uint8_t> buffer{0xCC}; // whatever was in there before must go
+	ASSERT_TRUE(WlnBuildReparseBuffer(WlnReparseTagMountPoint, L"\\??\\C:\\a", L"C:\\a", 0, buffer));
+
+	std::vector<uint8_t> expected{
+		0x03, 0x00, 0x00, 0xA0, // IO_REPARSE_TAG_MOUNT_POINT
+		0x24, 0x00, 0x00, 0x00, // ReparseDataLength, Reserved
+		0x00, 0x00, 0x10, 0x00, // SubstituteNameOffset, SubstituteNameLength
+		0x12, 0x00, 0x08, 0x00, // PrintNameOffset, PrintNameLength
+		'\\', 0, '?', 0, '?', 0, '\\', 0, 'C', 0, ':', 0, '\\', 0, 'a', 0, 0, 0,
+		'C', 0, ':', 0, '\\', 0, 'a', 0, 0, 0,
+	};
+	EXPECT_EQ(expected, buffer);
+}
+
+TEST(ReparseBufferTest, PutsSymlinkFlagsBeforeTheNames) {
+	std::vector<uint8_t> buffer;
+	ASSERT_TRUE(WlnBuildReparseBuffer(WlnReparseTagSymlink, L"a", L"a", WlnReparseSymlinkRelative, buffer));
+
+	std::vector<uint8_t> expected{
+		0x0C, 0x00, 0x00, 0xA0, // IO_REPARSE_TAG_SYMLINK
+		0x14, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x02, 0x00,
+		0x04, 0x00, 0x02, 0x00,
+		0x01, 0x00, 0x00, 0x00, // SYMLINK_FLAG_RELATIVE
+		'a', 0, 0, 0,
+		'a', 0, 0, 0,
+	};
+	EXPECT_EQ(expected, buffer);
+}
+
+TEST(ReparseBufferTest, RejectsNamesThatDontFit) {
+	std::vector<uint8_t> buffer;
+	std::wstring longName(WlnReparseMaximumSize / 2, L'x');
+	EXPECT_FALSE(WlnBuildReparseBuffer(WlnReparseTagMountPoint, longName, L"", 0, buffer));
+	EXPECT_FALSE(WlnBuildReparseBuffer(0x80000017, L"a", L"a", 0, buffer)); // not a link
+}
+
+TEST(ReparseBufferTest, RejectsEveryTruncation) {
+	std::vector<uint8_t> buffer;
+	ASSERT_TRUE(WlnBuildReparseBuffer(WlnReparseTagSymlink, L"\\??\\C:\\target", L"C:\\target", 0, buffer));
+
+	WlnReparseData data;
+	for(size_t length = 0; length < buffer.size(); ++length) {
+		EXPECT_FALSE(WlnParseReparseBuffer(buffer.data(), length, data)) << "length " << length;
+	}
+}
+
+// Random damage to a valid buffer must never make the parser read outside it
+// (run this under a sanitizer), and whatever it accepts must survive a rebuild.
+TEST(ReparseBufferTest, SurvivesCorruption) {
+	std::vector<uint8_t> original;
+	ASSERT_TRUE(WlnBuildReparseBuffer(WlnReparseTagSymlink, L"\\??\\C:\\target", L"C:\\target", 0, original));
+
+	std::mt19937 rng{12345};
+	WlnReparseData data;
+	std::vector<uint8_t> rebuilt;
+	for(int i = 0; i < 20000; ++i) {
+		std::vector<uint8_t> corrupt{original};
+		int flips = 1 + rng() % 4;
+		for(int f = 0; f < flips; ++f) {
+			corrupt[rng() % corrupt.size()] = static_cast<uint8_t>(rng());
+		}
+		corrupt.resize(rng() % (corrupt.size() + 1));
+
+		if(WlnParseReparseBuffer(corrupt.data(), corrupt.size(), data)) {
+			ASSERT_TRUE(WlnBuildReparseBuffer(data.tag, data.substituteName, data.printName, data.flags, rebuilt));
+			WlnReparseData again;
+			ASSERT_TRUE(WlnParseReparseBuffer(rebuilt.data(), rebuilt.size(), again));
+			EXPECT_EQ(data.substituteName, again.substituteName);
+			EXPECT_EQ(data.printName, again.printName);
+		}
+	}
+}
+
+// Making junctions in bulk builds a buffer for each, into one reused buffer.
+// This times that against allocating a new buffer every time. Allocating is
+// cheap next to the building, so the difference is only reported.
+TEST(ReparseBufferTimingTest, ReusesOneBufferForManyJunctions) {
+	constexpr int junctionCount = 1000000;
+	std::vector<std::wstring> targets;
+	std::vector<std::wstring> substituteNames;
+	for(int i = 0; i < 1000; ++i) {
+		targets.push_back(L"C:\\deploy\\packages\\package" + std::to_wstring(i) + L"\\1.0.0\\content");
+		substituteNames.push_back(L"\\??\\" + targets.back());
+	}
+
+	std::vector<uint8_t> buffer;
+	int failures = 0;
+	double reusing = timeMilliseconds([&]() {
+		for(int i = 0; i < junctionCount; ++i) {
+			size_t t = i % targets.size();
+			failures += !WlnBuildReparseBuffer(WlnReparseTagMountPoint, substituteNames[t], targets[t], 0, buffer);
+		}
+	});
+	double allocating = timeMilliseconds([&]() {
+		for(int i = 0; i < junctionCount; ++i) {
+			size_t t = i % targets.size();
+			std::vector<uint8_t> fresh;
+			failures += !WlnBuildReparseBuffer(WlnReparseTagMountPoint, substituteNames[t], targets[t], 0, fresh);
+		}
+	});
+
+	EXPECT_EQ(0, failures);
+	WlnReparseData data;
+	ASSERT_TRUE(WlnParseReparseBuffer(buffer.data(), buffer.size(), data));
+	EXPECT_EQ(targets.back(), data.printName);
+	reportTiming("1000000 junction buffers, one reused", reusing);
+	reportTiming("1000000 junction buffers, each allocated", allocating);
+}
+
+// Buffers as FSCTL_GET_REPARSE_POINT returns them for links Windows made
+// itself: CreateSymbolicLinkW stores the print name first with no NULs, and
+// mklink /J stores both names NUL-terminated, substitute name first.
+struct capturedcase {
+	const char* name;
+	std::vector<uint8_t> buffer;
+	WlnReparseData expected;
+};
+
+class ReparseCapturedTest: public ::testing::TestWithParam<struct capturedcase> {
+};
+
+TEST_P(ReparseCapturedTest, Parses) {
+	auto& testcase = GetParam();
+	WlnReparseData data;
+	ASSERT_TRUE(WlnParseReparseBuffer(testcase.buffer.data(), testcase.buffer.size(), data)) << testcase.name;
+	EXPECT_EQ(testcase.expected.tag, data.tag);
+	EXPECT_EQ(testcase.expected.substituteName, data.substituteName);
+	EXPECT_EQ(testcase.expected.printName, data.printName);
+	EXPECT_EQ(testcase.expected.flags, data.flags);
+}
+
+struct capturedcase capturedCases[]{
+	{"mklink link C:\\t", {
+		0x0C, 0x00, 0x00, 0xA0, 0x24, 0x00, 0x00, 0x00,
+		0x08, 0x00, 0x10, 0x00, 0x00, 0x00, 0x08, 0x00,
+		0x00, 0x00, 0x00, 0x00,
+		'C', 0, ':', 0, '\\', 0, 't', 0,
+		'\\', 0, '?', 0, '?', 0, '\\', 0, 'C', 0, ':', 0, '\\', 0, 't', 0,
+	}, {WlnReparseTagSymlink, L"\\??\\C:\\t", L"C:\\t", 0}},
+	{"mklink link ..\\t", {
+		0x0C, 0x00, 0x00, 0xA0, 0x1C, 0x00, 0x00, 0x00,
+		0x08, 0x00, 0x08, 0x00, 0x00, 0x00, 0x08, 0x00,
+		0x01, 0x00, 0x00, 0x00,
+		'.', 0, '.', 0, '\\', 0, 't', 0,
+		'.', 0, '.', 0, '\\', 0, 't', 0,
+	}, {WlnReparseTagSymlink, L"..\\t", L"..\\t", WlnReparseSymlinkRelative}},
+	{"mklink /J link C:\\t", {
+		0x03, 0x00, 0x00, 0xA0, 0x24, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x10, 0x00, 0x12, 0x00, 0x08, 0x00,
+		'\\', 0, '?', 0, '?', 0, '\\', 0, 'C', 0, ':', 0, '\\', 0, 't', 0, 0, 0,
+		'C', 0, ':', 0, '\\', 0, 't', 0, 0, 0,
+	}, {WlnReparseTagMountPoint, L"\\??\\C:\\t", L"C:\\t", 0}},
+	{"FSCTL_GET_REPARSE_POINT output buffer with slack", {
+		0x03, 0x00, 0x00, 0xA0, 0x0C, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x02, 0x00, 0x04, 0x00, 0x00, 0x00,
+		'x', 0, 0, 0,
+		0xEE, 0xEE, 0xEE, 0xEE, // past ReparseDataLength; must be ignored
+	}, {WlnReparseTagMountPoint, L"x", L"", 0}},
+};
+
+INSTANTIATE_TEST_CASE_P(Reparse, ReparseCapturedTest, ::testing::ValuesIn(capturedCases));
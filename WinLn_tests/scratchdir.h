@@ -0,0 +1,30 @@
+#pragma once
+
+#include <WinLn/fs.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+// scratchdir is a fresh directory for one test, removed again afterwards.
+class scratchdir {
+public:
+	std::filesystem::path path;
+
+	scratchdir() {
+		static int count = 0;
+		path = std::filesystem::temp_directory_path() / ("winln_tests_" + std::to_string(WlnFsGetProcessId()) + "_" + std::to_string(count++));
+		std::filesystem::remove_all(path);
+		std::filesystem::create_directories(path);
+	}
+
+	~scratchdir() {
+		std::error_code ec;
+		std::filesystem::remove_all(path, ec);
+	}
+
+	std::wstring file(const wchar_t* name, const char* contents) {
+		std::filesystem::create_directories((path / name).parent_path());
+		std::ofstream{path / name} << contents;
+		return (path / name).wstring();
+	}
+};
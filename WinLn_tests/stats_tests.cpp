@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include <WinLn/stats.h>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Percentiles come from histogram buckets, so they're only this close.
+static void expectNear(uint64_t expected, uint64_t actual) {
+	EXPECT_LE(actual, expected + expected / 16) << "expected about " << expected;
+	EXPECT_GE(actual, expected - expected / 16) << "expected about " << expected;
+}
+
+TEST(StatsTest, SummarizesPercentiles) {
+	WlnResetStats();
+	for(uint64_t i = 1; i <= 1000; ++i) {
+		WlnRecordStat(WlnStatPhase::CreateLink, i * 1000);
+	}
+
+	auto summary{WlnSummarizeStats(WlnStatPhase::CreateLink)};
+	EXPECT_EQ(1000u, summary.count);
+	EXPECT_EQ(500500000u, summary.totalNanoseconds);
+	expectNear(500000, summary.p50Nanoseconds);
+	expectNear(990000, summary.p99Nanoseconds);
+
+	EXPECT_EQ(0u, WlnSummarizeStats(WlnStatPhase::ResolvePath).count);
+}
+
+TEST(StatsTest, KeepsShortTimingsExact) {
+	WlnResetStats();
+	for(uint64_t i = 0; i < 10; ++i) {
+		WlnRecordStat(WlnStatPhase::ResolvePath, 7);
+	}
+	auto summary{WlnSummarizeStats(WlnStatPhase::ResolvePath)};
+	EXPECT_EQ(7u, summary.p50Nanoseconds);
+	EXPECT_EQ(7u, summary.p99Nanoseconds);
+}
+
+TEST(StatsTest, SurvivesHugeTimings) {
+	WlnResetStats();
+	WlnRecordStat(WlnStatPhase::ReplaceLink, UINT64_MAX / 2);
+	auto summary{WlnSummarizeStats(WlnStatPhase::ReplaceLink)};
+	EXPECT_EQ(1u, summary.count);
+	EXPECT_GT(summary.p99Nanoseconds, uint64_t{1} << 47);
+}
+
+// Each thread keeps its own timings until it ends.
+TEST(StatsTest, MergesThreadsThatHaveEnded) {
+	WlnResetStats();
+	std::vector<std::thread> threads;
+	for(int t = 0; t < 4; ++t) {
+		threads.emplace_back([]() {
+			for(int i = 0; i < 250; ++i) {
+				WlnRecordStat(WlnStatPhase::QueryFileInfo, 2000);
+			}
+		});
+	}
+	for(auto& thread : threads) {
+		thread.join();
+	}
+	WlnRecordStat(WlnStatPhase::QueryFileInfo, 2000);
+
+	auto summary{WlnSummarizeStats(WlnStatPhase::QueryFileInfo)};
+	EXPECT_EQ(1001u, summary.count);
+	expectNear(2000, summary.p50Nanoseconds);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// timeMilliseconds returns how long f takes to run.
+template<typename F>
+double timeMilliseconds(F&& f) {
+	auto start = std::chrono::steady_clock::now();
+	f();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// reportTiming prints what a timing check measured, next to the test's
+// results. How much one way beats another depends on the machine and its
+// disks, so checks only fail on results that can't be right anywhere.
+inline void reportTiming(const std::string& what, double milliseconds) {
+	printf("[   TIME   ] %s: %.1f ms\n", what.c_str(), milliseconds);
+}
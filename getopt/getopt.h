@@ -9,7 +9,7 @@ extern "C" {
 extern bool _optreset;
 extern int optind;
 extern wchar_t* optarg;
-int getopt_long(int argc, wchar_t** argv, const struct option opts[]);
+int getopt_long(int argc, wchar_t** argv, const option opts[]);
 
 #ifdef __cplusplus
 }
@@ -7,6 +7,8 @@ bool _optreset = true;
 int optind = 0;
 wchar_t* optarg = nullptr;
 
+// getopt_long is a parser (optparser) shared by the whole process. Code that
+// parses on more than one thread should keep its own.
 static optparser globalParser;
 int getopt_long(int argc, wchar_t** argv, const option opts[]) {
 	if(_optreset) {
@@ -16,10 +18,10 @@ int getopt_long(int argc, wchar_t** argv, const option opts[]) {
 		_optreset = false;
 	}
 
-	int ret = globalParser.next();
-	optind = globalParser.get_index();
-	optarg = globalParser.get_arg();
-	return ret;
+	optresult result{globalParser.parse()};
+	optind = result.index;
+	optarg = result.arg;
+	return result.option;
 }
 
 #ifdef TEST_GETOPT
@@ -1,111 +1,197 @@
 #include "optparser.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <type_traits>
 
-void optparser::reset(int argc, wchar_t ** argv, const option opts[]) {
+// unit is c as a code unit, which char (unlike wchar_t on Windows) would
+// otherwise make negative past ASCII.
+template<typename CharT>
+static auto unit(CharT c) {
+	return static_cast<std::make_unsigned_t<CharT>>(c);
+}
+
+// compare is strncmp for either type of character.
+template<typename CharT>
+static int compare(const CharT* a, const CharT* b, size_t length = SIZE_MAX) {
+	for(; length; --length, ++a, ++b) {
+		if(*a != *b) return unit(*a) < unit(*b) ? -1 : 1;
+		if(*a == CharT{}) break;
+	}
+	return 0;
+}
+
+template<typename CharT>
+void basic_optindex<CharT>::reset(const basic_option<CharT> opts[]) {
+	_options = &opts[0];
+	std::fill(std::begin(_short), std::end(_short), nullptr);
+	_long.clear();
+	for(auto o = _options; o->name; ++o) {
+		if(o->shopt >= 0 && o->shopt < 256 && !_short[o->shopt]) {
+			_short[o->shopt] = o;
+		}
+		_long.push_back(o);
+	}
+	std::stable_sort(_long.begin(), _long.end(), [](const basic_option<CharT>* a, const basic_option<CharT>* b) {
+		return compare(a->name, b->name) < 0;
+	});
+}
+
+template<typename CharT>
+const basic_option<CharT>* basic_optindex<CharT>::find_short(CharT shopt) const {
+	if(unit(shopt) < 256) {
+		return _short[unit(shopt)];
+	}
+	for(auto o = _options; o->name; ++o) {
+		if(static_cast<unsigned long>(o->shopt) == unit(shopt)) return o;
+	}
+	return nullptr;
+}
+
+template<typename CharT>
+const basic_option<CharT>* basic_optindex<CharT>::find_long(const CharT* name, size_t length) const {
+	// name isn't terminated at length (it's followed by =value, perhaps), so
+	// an option name sorts before it only if it's less in the first length
+	// characters.
+	auto it = std::lower_bound(_long.begin(), _long.end(), name, [length](const basic_option<CharT>* o, const CharT* name) {
+		return compare(o->name, name, length) < 0;
+	});
+	if(it == _long.end() || compare((*it)->name, name, length) != 0 || (*it)->name[length] != CharT{}) {
+		return nullptr;
+	}
+	return *it;
+}
+
+template<typename CharT>
+void basic_optparser<CharT>::reset(int argc, CharT** argv, const basic_option<CharT> opts[]) {
 	_argc = argc;
 	_argv = argv;
-	_lastarg = 1;
+	_optslots.clear();
+	_done = false;
 	_optind = 1; // skip argv[0], progname
+	_scanpos = 1;
 	_optpos = 0;
 	_optarg = nullptr;
 
-	_options = &opts[0];
+	_index.reset(opts);
 }
 
-int optparser::next() {
-	int idx = _optind;
+// finish moves every option found, in order, ahead of the other arguments,
+// which keep their order too, and points optind at the first of those.
+template<typename CharT>
+void basic_optparser<CharT>::finish() {
+	_done = true;
+	_optind = 1 + static_cast<int>(_optslots.size());
+	if(_optslots.empty() || _optslots.back() == static_cast<int>(_optslots.size())) {
+		return; // the options are in front already
+	}
+
+	// 12 34 -s 56 78 -r val      _optslots: 2 5 6
+	// -s -r val 12 34 56 78
+	_scratch.clear();
+	_scratch.reserve(_argc - 1);
+	for(int slot : _optslots) {
+		_scratch.push_back(_argv[slot]);
+	}
+	size_t nextslot = 0;
+	for(int i = 1; i < _argc; ++i) {
+		if(nextslot < _optslots.size() && _optslots[nextslot] == i) {
+			++nextslot;
+			continue;
+		}
+		_scratch.push_back(_argv[i]);
+	}
+	std::copy(_scratch.begin(), _scratch.end(), _argv + 1);
+}
+
+template<typename CharT>
+int basic_optparser<CharT>::next() {
+	if(_done) {
+		_optarg = nullptr;
+		return -1;
+	}
+
+	int idx = _scanpos;
 	if(!_optpos) {
 		// no option position (later, if we hit the end of the pack, we clear it)
-		for(; idx < _argc && _argv[idx][0] != L'-'; ++idx);
+		for(; idx < _argc && _argv[idx][0] != CharT('-'); ++idx);
 	}
 
-	if(idx == _argc) {
+	if(idx >= _argc) {
+		finish();
 		_optarg = nullptr;
 		return -1; // no more args, we're done!
 	}
 
-	wchar_t* arg = _argv[idx];
-	bool longopt = arg[1] == L'-';
+	CharT* arg = _argv[idx];
+	bool longopt = arg[1] == CharT('-');
 
-	const option* foundopt = nullptr;
-	wchar_t* foundarg = nullptr;
+	const basic_option<CharT>* foundopt = nullptr;
+	CharT* foundarg = nullptr;
 	int npos = 1; // number of positions occupied by args and options
 
 	if(!_optpos && !longopt) _optpos = 1;
 
-	for(const option* o = _options; o->name; ++o) {
-		bool found = false;
-		if(!longopt && arg[_optpos] == o->shopt) {
-			found = true;
-			if(o->has_arg && arg[_optpos + 1] != L'\0') {
-				// special case: argument specified right after option
-				foundarg = arg + _optpos + 1;
-				_optpos = -1; // incremented later, to 0
-			}
-		} else if(longopt) {
-			wchar_t* eq = wcschr(arg, L'=');
-			int arglen = eq ? eq - arg - 2 : wcslen(arg + 2); // 2: length of --
-			if(
-				wcslen(o->name) != arglen // lengths don't match
-				|| wcsncmp(arg + 2, o->name, arglen) != 0 // or text doesn't match
-				) continue; // no match
-
-			if(eq) {
-				foundarg = eq + 1;
-			}
-			found = true;
-		} else {
-			continue; // no match
+	const basic_option<CharT>* o;
+	if(longopt) {
+		CharT* eq = arg + 2;
+		for(; *eq && *eq != CharT('='); ++eq);
+		size_t arglen = eq - arg - 2; // 2: length of --
+		if(!*eq) eq = nullptr;
+		o = _index.find_long(arg + 2, arglen);
+		if(o && eq) {
+			foundarg = eq + 1;
 		}
+	} else {
+		o = _index.find_short(arg[_optpos]);
+		if(o && o->has_arg && arg[_optpos + 1] != CharT{}) {
+			// special case: argument specified right after option
+			foundarg = arg + _optpos + 1;
+			_optpos = -1; // incremented later, to 0
+		}
+	}
 
-		if(found) {
-			if(o->has_arg && !foundarg) {
-				int argpos = idx + 1;
-				if(argpos >= _argc) break; // option missing arg: opterr?
-
+	if(o) {
+		foundopt = o;
+		if(o->has_arg && !foundarg) {
+			int argpos = idx + 1;
+			if(argpos >= _argc) {
+				foundopt = nullptr; // option missing arg: opterr?
+			} else {
 				++npos; // Consume another slot
 				foundarg = _argv[argpos];
 			}
-
-			foundopt = o;
-			break;
 		}
 	}
 
 	_optpos += static_cast<int>(!longopt); // increment only if short opt
+	_scanpos = idx;
 	_optind = idx;
 
-	if(!_optpos || arg[_optpos] == L'\0') {
+	if(!_optpos || arg[_optpos] == CharT{}) {
+		// the end of this option (or pack): optind counts the options so far,
+		// as though they had been moved to the front already.
 		_optpos = 0;
-		if(idx != _lastarg) {
-			// if this option isn't adjacent to the last one,
-			// move it down so it is.
-
-			wchar_t* save[2];
-			memmove(save, _argv + idx, npos * sizeof(wchar_t*));
-			// 12 34 -s 56 78 -r val
-			// |la   |idx         npos=1
-			// |S |D              (memmove Src, Dst)
-			// |-----|            (memmove Len)
-			// later,
-			// -s 12 34 56 78 -r val
-			//    |la         |idx npos=2
-			//    |S    | D        Src, Dst
-			//    |-----------|    Len
-			memmove(_argv + _lastarg + npos, _argv + _lastarg, (idx - _lastarg) * sizeof(wchar_t*));
-			memmove(_argv + _lastarg, save, npos * sizeof(wchar_t*));
+		for(int i = 0; i < npos; ++i) {
+			_optslots.push_back(idx + i);
 		}
-		_lastarg += npos;
-		_optind = _lastarg;
+		_scanpos = idx + npos;
+		_optind = 1 + static_cast<int>(_optslots.size());
 	}
 
 	_optarg = foundarg;
 
-	if(longopt && arg[2] == L'\0') {
+	if(longopt && arg[2] == CharT{}) {
+		finish();
 		return -1;
 	}
 
-	return foundopt ? foundopt->shopt : L'?';
+	return foundopt ? foundopt->shopt : '?';
 }
+
+template class basic_optindex<char>;
+template class basic_optindex<wchar_t>;
+template class basic_optparser<char>;
+template class basic_optparser<wchar_t>;
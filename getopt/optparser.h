@@ -1,37 +1,98 @@
 #pragma once
 
-struct option {
-	const wchar_t* name;
-	wchar_t shopt;
+#include <cstddef>
+#include <vector>
+
+// The parser works on argv as it's passed, wide (wchar_t, for wmain) or
+// narrow (char, for a POSIX main); option, optparser and friends are the
+// wide ones.
+
+template<typename CharT>
+struct basic_option {
+	const CharT* name;
+	int shopt; // returned when the option is found, and typed as -<shopt> if it fits in a CharT
 	bool has_arg;
 };
 
-#ifdef __cplusplus
-class optparser {
+// optindex finds options without scanning the whole table: short options
+// below 256 by direct lookup, long ones by binary search over their sorted
+// names. Where several options share a name, the first in the table wins.
+template<typename CharT>
+class basic_optindex {
+private:
+	const basic_option<CharT>* _options;
+	const basic_option<CharT>* _short[256];
+	std::vector<const basic_option<CharT>*> _long; // sorted by name
+
+public:
+	void reset(const basic_option<CharT> opts[]);
+	const basic_option<CharT>* find_short(CharT shopt) const;
+	const basic_option<CharT>* find_long(const CharT* name, size_t length) const;
+};
+
+// optresult is what one step of parsing found.
+template<typename CharT>
+struct basic_optresult {
+	int option; // the option's shopt, '?' for an unknown option, or -1 at the end
+	int index; // optind
+	CharT* arg; // optarg: the option's argument, if it has one
+};
+
+// optparser holds all the state of parsing one command line, so that
+// several can be parsed at once, on different threads.
+template<typename CharT>
+class basic_optparser {
 private:
 	int _argc;
-	wchar_t** _argv;
+	CharT** _argv;
+
+	// Options are moved ahead of the other arguments all at once, when
+	// parsing ends, so that it takes time in proportion to argc however
+	// they're interspersed. Until then, argv is as it was passed.
+	std::vector<int> _optslots; // indices of options (and their args) in argv
+	std::vector<CharT*> _scratch; // for putting argv in order
+	bool _done;
 
-	int _lastarg; // last found arg (for compaction)
-	// we have to keep track of lastarg because we must defer compaction
-	// until the end of all options in a single pack, but optind must stay
-	// the same during pack processing.
 	int _optind; // index of current option in argv
+	int _scanpos; // index in argv to look for the next option at
 	int _optpos; // position of current option in argv[optind] (for packs)
-	wchar_t* _optarg; // current argument (if any?)
+	CharT* _optarg; // current argument (if any?)
+
+	basic_optindex<CharT> _index;
 
-	const option* _options;
+	void finish();
 
 public:
-	void reset(int argc, wchar_t** argv, const option opts[]);
+	basic_optparser() = default;
+	basic_optparser(int argc, CharT** argv, const basic_option<CharT> opts[]) {
+		reset(argc, argv, opts);
+	}
+
+	void reset(int argc, CharT** argv, const basic_option<CharT> opts[]);
 	int next();
 
+	// parse is next, returning optind and optarg along with the option.
+	basic_optresult<CharT> parse() {
+		int option = next();
+		return basic_optresult<CharT>{option, _optind, _optarg};
+	}
+
 	int get_index() const {
 		return _optind;
 	}
 
-	wchar_t* get_arg() {
+	CharT* get_arg() {
 		return _optarg;
 	}
 };
-#endif
\ No newline at end of file
+
+// optparser.cpp instantiates these.
+extern template class basic_optindex<char>;
+extern template class basic_optindex<wchar_t>;
+extern template class basic_optparser<char>;
+extern template class basic_optparser<wchar_t>;
+
+using option = basic_option<wchar_t>;
+using optindex = basic_optindex<wchar_t>;
+using optresult = basic_optresult<wchar_t>;
+using optparser = basic_optparser<wchar_t>;
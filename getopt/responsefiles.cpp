@@ -0,0 +1,321 @@
+#include "responsefiles.h"
+
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+static const int malformedError = ERROR_NO_UNICODE_TRANSLATION;
+#else
+#include <cerrno>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const int malformedError = EILSEQ;
+#endif
+
+#ifdef _WIN32
+// mapfile maps the file at path copy-on-write, so that it can be split into
+// arguments in place. data is null for an empty file.
+static int mapfile(const wchar_t* path, void*& data, size_t& size) {
+	data = nullptr;
+	size = 0;
+	HANDLE hFile{CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr)};
+	if(hFile == INVALID_HANDLE_VALUE) {
+		return GetLastError();
+	}
+
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(hFile, &fileSize)) {
+		int gle = GetLastError();
+		CloseHandle(hFile);
+		return gle;
+	}
+	if(static_cast<uint64_t>(fileSize.QuadPart) > SIZE_MAX) {
+		CloseHandle(hFile);
+		return ERROR_NOT_ENOUGH_MEMORY;
+	}
+	// Empty files can't be mapped.
+	if(fileSize.QuadPart == 0) {
+		CloseHandle(hFile);
+		return 0;
+	}
+
+	HANDLE hMapping{CreateFileMappingW(hFile, nullptr, PAGE_WRITECOPY, 0, 0, nullptr)};
+	int gle = hMapping ? 0 : GetLastError();
+	CloseHandle(hFile);
+	if(!hMapping) {
+		return gle;
+	}
+	// The view keeps the mapping (and the file) open.
+	data = MapViewOfFile(hMapping, FILE_MAP_COPY, 0, 0, 0);
+	gle = data ? 0 : GetLastError();
+	CloseHandle(hMapping);
+	if(!data) {
+		return gle;
+	}
+	size = static_cast<size_t>(fileSize.QuadPart);
+	return 0;
+}
+
+static void unmapfile(void* data, size_t) {
+	if(data) UnmapViewOfFile(data);
+}
+#else
+// narrow encodes path (UTF-32) as UTF-8 for the system.
+static bool narrow(const wchar_t* path, std::string& out) {
+	out.clear();
+	for(; *path; ++path) {
+		uint32_t cp = static_cast<uint32_t>(*path);
+		if(cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return false;
+		if(cp < 0x80) {
+			out += static_cast<char>(cp);
+		} else if(cp < 0x800) {
+			out += static_cast<char>(0xC0 | (cp >> 6));
+			out += static_cast<char>(0x80 | (cp & 0x3F));
+		} else if(cp < 0x10000) {
+			out += static_cast<char>(0xE0 | (cp >> 12));
+			out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (cp & 0x3F));
+		} else {
+			out += static_cast<char>(0xF0 | (cp >> 18));
+			out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+			out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (cp & 0x3F));
+		}
+	}
+	return true;
+}
+
+// mapfile maps the file at path copy-on-write, so that it can be split into
+// arguments in place. data is null for an empty file.
+static int mapfile(const wchar_t* path, void*& data, size_t& size) {
+	data = nullptr;
+	size = 0;
+	std::string npath;
+	if(!narrow(path, npath)) return malformedError;
+
+	int fd = open(npath.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		return errno;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0) {
+		int err = errno;
+		close(fd);
+		return err;
+	}
+	if(static_cast<uint64_t>(st.st_size) > SIZE_MAX) {
+		close(fd);
+		return EFBIG;
+	}
+	if(st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+
+	void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	int err = mapped == MAP_FAILED ? errno : 0;
+	close(fd); // the mapping keeps the file
+	if(err) {
+		return err;
+	}
+	data = mapped;
+	size = static_cast<size_t>(st.st_size);
+	return 0;
+}
+
+static void unmapfile(void* data, size_t size) {
+	if(data) munmap(data, size);
+}
+#endif
+
+// put writes code point cp to out as one or two wchar_ts.
+static wchar_t* put(wchar_t* out, uint32_t cp) {
+	if(sizeof(wchar_t) == 2 && cp >= 0x10000) {
+		cp -= 0x10000;
+		*out++ = static_cast<wchar_t>(0xD800 + (cp >> 10));
+		*out++ = static_cast<wchar_t>(0xDC00 + (cp & 0x3FF));
+	} else {
+		*out++ = static_cast<wchar_t>(cp);
+	}
+	return out;
+}
+
+// decodeUtf8 converts size bytes of UTF-8 into out, which has room for size
+// wchar_ts (enough: no code point takes more wchar_ts than bytes).
+static bool decodeUtf8(const uint8_t* in, size_t size, wchar_t* out, size_t& length) {
+	const uint8_t* end = in + size;
+	wchar_t* start = out;
+	while(in < end) {
+		uint32_t cp = *in++;
+		int more;
+		uint32_t min;
+		if(cp < 0x80) {
+			more = 0;
+			min = 0;
+		} else if(cp >= 0xC2 && cp < 0xE0) {
+			more = 1;
+			min = 0x80;
+			cp &= 0x1F;
+		} else if(cp >= 0xE0 && cp < 0xF0) {
+			more = 2;
+			min = 0x800;
+			cp &= 0x0F;
+		} else if(cp >= 0xF0 && cp < 0xF5) {
+			more = 3;
+			min = 0x10000;
+			cp &= 0x07;
+		} else {
+			return false;
+		}
+		if(end - in < more) return false;
+		for(; more; --more) {
+			if((*in & 0xC0) != 0x80) return false;
+			cp = (cp << 6) | (*in++ & 0x3F);
+		}
+		if(cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return false;
+		out = put(out, cp);
+	}
+	length = out - start;
+	return true;
+}
+
+// decodeUtf16 converts size bytes of UTF-16LE into out, which has room for
+// size / 2 wchar_ts.
+static bool decodeUtf16(const uint8_t* in, size_t size, wchar_t* out, size_t& length) {
+	if(size % 2) return false;
+	const uint8_t* end = in + size;
+	wchar_t* start = out;
+	while(in < end) {
+		uint32_t cp = in[0] | (in[1] << 8);
+		in += 2;
+		if(cp >= 0xD800 && cp < 0xDC00 && in < end) {
+			uint32_t low = in[0] | (in[1] << 8);
+			if(low >= 0xDC00 && low <= 0xDFFF) {
+				in += 2;
+				cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+			}
+		}
+		if(cp >= 0xD800 && cp <= 0xDFFF) return false; // unpaired
+		out = put(out, cp);
+	}
+	length = out - start;
+	return true;
+}
+
+static bool isseparator(wchar_t c) {
+	return c == L' ' || c == L'\t' || c == L'\r' || c == L'\n' || c == L'\0';
+}
+
+// tokenize splits text[start, end) into arguments, which it writes back from
+// text[0] and appends to args. Removing quotes and escapes only shortens an
+// argument, and start is at least 1, so there's always room for each one's
+// terminator.
+static void tokenize(wchar_t* text, size_t start, size_t end, std::vector<wchar_t*>& args) {
+	const wchar_t* in = text + start;
+	const wchar_t* stop = text + end;
+	wchar_t* out = text;
+	for(;;) {
+		while(in < stop && isseparator(*in)) ++in;
+		if(in == stop) break;
+
+		wchar_t* arg = out;
+		bool quoted = false;
+		while(in < stop && (quoted ? *in != L'\0' : !isseparator(*in))) {
+			if(*in == L'\\') {
+				// 2n backslashes and a quote are n backslashes, and the quote
+				// opens or closes; 2n+1 are n and a literal quote. Backslashes
+				// anywhere else are just backslashes.
+				size_t n = 0;
+				for(; in < stop && *in == L'\\'; ++in) ++n;
+				bool beforeQuote = in < stop && *in == L'"';
+				for(size_t i = beforeQuote ? n / 2 : n; i; --i) *out++ = L'\\';
+				if(beforeQuote && n % 2) {
+					*out++ = *in++;
+				}
+			} else if(*in == L'"') {
+				quoted = !quoted;
+				++in;
+			} else {
+				*out++ = *in++;
+			}
+		}
+		*out++ = L'\0';
+		args.push_back(arg);
+	}
+}
+
+responsefiles::~responsefiles() {
+	for(auto& view : _views) {
+		unmapfile(view.data, view.size);
+	}
+}
+
+int responsefiles::read(const wchar_t* path) {
+	void* data;
+	size_t size;
+	if(int err = mapfile(path, data, size)) return err;
+	if(!data) return 0;
+
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	bool utf16 = size >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE;
+	if(utf16 && sizeof(wchar_t) == 2 && size % 2 == 0) {
+		// Split it where it lies; the byte order mark makes room.
+		_views.push_back({data, size});
+		tokenize(static_cast<wchar_t*>(data), 1, size / 2, _argv);
+		return 0;
+	}
+
+	// One more, at the front, for tokenize.
+	std::unique_ptr<wchar_t[]> buffer{new wchar_t[size + 1]};
+	size_t length;
+	bool decoded;
+	if(utf16) {
+		decoded = decodeUtf16(bytes + 2, size - 2, buffer.get() + 1, length);
+	} else {
+		size_t bom = size >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF ? 3 : 0;
+		decoded = decodeUtf8(bytes + bom, size - bom, buffer.get() + 1, length);
+	}
+	unmapfile(data, size);
+	if(!decoded) return malformedError;
+
+	tokenize(buffer.get(), 1, length + 1, _argv);
+	_buffers.push_back(std::move(buffer));
+	return 0;
+}
+
+int responsefiles::expand(int& argc, wchar_t**& argv, const wchar_t** failed) {
+	// Most command lines have nothing to expand.
+	bool any = false;
+	for(int i = 1; i < argc && !any && wcscmp(argv[i], L"--") != 0; ++i) {
+		any = argv[i][0] == L'@' && argv[i][1] != L'\0';
+	}
+	if(!any) return 0;
+
+	_argv.clear();
+	_argv.push_back(argv[0]);
+	bool literal = false;
+	for(int i = 1; i < argc; ++i) {
+		wchar_t* arg = argv[i];
+		if(literal || arg[0] != L'@' || arg[1] == L'\0') {
+			literal = literal || wcscmp(arg, L"--") == 0;
+			_argv.push_back(arg);
+			continue;
+		}
+		if(int err = read(arg + 1)) {
+			if(failed) *failed = arg + 1;
+			return err;
+		}
+	}
+	argc = static_cast<int>(_argv.size());
+	_argv.push_back(nullptr);
+	argv = _argv.data();
+	return 0;
+}
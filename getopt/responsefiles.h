@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// responsefiles replaces @file arguments with the arguments in file, so that
+// a command line can be longer than the system allows.
+//
+// A response file is UTF-8, or UTF-16LE if it starts with a byte order mark.
+// Arguments are separated by whitespace (or NULs), and quoted the way
+// Windows command lines are: "" groups, and backslashes only escape quotes.
+// Arguments after -- aren't expanded, and neither are @file arguments
+// inside response files.
+//
+// Files are mapped copy-on-write and split into arguments where they lie,
+// unless they have to be converted to wchar_t first (into one buffer per
+// file), so the arguments are never copied one by one.
+class responsefiles {
+private:
+	struct view {
+		void* data;
+		size_t size;
+	};
+
+	std::vector<view> _views; // files split in place
+	std::vector<std::unique_ptr<wchar_t[]>> _buffers; // files that were converted
+	std::vector<wchar_t*> _argv;
+
+	int read(const wchar_t* path);
+
+public:
+	responsefiles() = default;
+	~responsefiles();
+
+	responsefiles(const responsefiles&) = delete;
+	responsefiles& operator=(const responsefiles&) = delete;
+
+	// expand replaces argc and argv with the expanded command line, which
+	// lasts as long as this does. It returns a system error code (and sets
+	// failed to the file that couldn't be read, if it's given) or 0; argc
+	// and argv are unchanged if there was nothing to expand.
+	int expand(int& argc, wchar_t**& argv, const wchar_t** failed = nullptr);
+};
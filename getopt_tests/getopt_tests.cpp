@@ -1,5 +1,11 @@
 #include <gtest/gtest.h>
 #include <getopt/getopt.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cwchar>
+#include <thread>
+#include <tuple>
 #include <type_traits>
 #include <vector>
 #include <string>
@@ -9,8 +15,29 @@ static option opts[] = {
 	{L"longname_a", L'a', true},
 	{L"longname_b", L'b', false},
 	{L"longname_c", L'c', false},
+	{nullptr, 0, false},
 };
 
+// The same options, for parsing narrow argv.
+static basic_option<char> narrowOpts[] = {
+	{"short", 's', false},
+	{"longname_a", 'a', true},
+	{"longname_b", 'b', false},
+	{"longname_c", 'c', false},
+	{nullptr, 0, false},
+};
+
+// The test cases are all ASCII, so they narrow and widen trivially.
+static std::string narrow(const std::wstring& text) {
+	std::string narrowed;
+	for(wchar_t c : text) narrowed += static_cast<char>(c);
+	return narrowed;
+}
+
+static std::wstring widen(const std::string& text) {
+	return std::wstring(text.begin(), text.end());
+}
+
 struct testcase {
 	std::vector<wchar_t*> cmdline;
 	std::vector<int> expectedResponses;
@@ -18,10 +45,22 @@ struct testcase {
 	std::vector<std::wstring> expectedRemainingArguments;
 };
 
-class GetoptTest: public ::testing::TestWithParam<struct testcase> {
+// Every case is parsed both from wide argv, through getopt_long, and from
+// narrow argv, through a parser for char.
+enum class argvtype {
+	wide,
+	narrow,
+};
+
+class GetoptTest: public ::testing::TestWithParam<std::tuple<argvtype, struct testcase>> {
 public:
 	void SetUp() {
-		auto& testcase = GetParam();
+		auto& testcase = std::get<1>(GetParam());
+		if(std::get<0>(GetParam()) == argvtype::narrow) {
+			parseNarrow(testcase);
+			return;
+		}
+
 		std::vector<wchar_t*> copiedCmdline{testcase.cmdline};
 		std::vector<int> responses;
 		std::vector<std::wstring> arguments;
@@ -38,6 +77,23 @@ public:
 		_arguments = std::move(arguments);
 		_remainingParameters = std::move(afterOptind);
 	}
+
+	void parseNarrow(const struct testcase& testcase) {
+		std::vector<std::string> narrowed;
+		for(auto arg : testcase.cmdline) narrowed.emplace_back(narrow(arg));
+		std::vector<char*> copiedCmdline;
+		for(auto& arg : narrowed) copiedCmdline.push_back(arg.data());
+
+		basic_optparser<char> parser{static_cast<int>(copiedCmdline.size()), copiedCmdline.data(), narrowOpts};
+		basic_optresult<char> result;
+		while((result = parser.parse()).option != -1) {
+			_responses.emplace_back(result.option);
+			if(result.arg) _arguments.emplace_back(widen(result.arg));
+		}
+		for(auto it = copiedCmdline.begin() + result.index; it != copiedCmdline.end(); ++it) {
+			_remainingParameters.emplace_back(widen(*it));
+		}
+	}
 protected:
 	std::vector<int> _responses;
 	std::vector<std::wstring> _arguments;
@@ -45,17 +101,17 @@ protected:
 };
 
 TEST_P(GetoptTest, ReturnsOptions) {
-	auto& testcase = GetParam();
+	auto& testcase = std::get<1>(GetParam());
 	ASSERT_EQ(testcase.expectedResponses, _responses);
 }
 
 TEST_P(GetoptTest, ReturnsOptionArguments) {
-	auto& testcase = GetParam();
+	auto& testcase = std::get<1>(GetParam());
 	EXPECT_EQ(testcase.expectedOptionArguments, _arguments);
 }
 
 TEST_P(GetoptTest, SortsAndReturnsNonOptionParameters) {
-	auto& testcase = GetParam();
+	auto& testcase = std::get<1>(GetParam());
 	EXPECT_EQ(testcase.expectedRemainingArguments, _remainingParameters);
 }
 
@@ -114,6 +170,205 @@ struct testcase cases[]{
 		/* args */ {},
 		/* left */ {},
 	},
+	{ // Long Options - Prefixes and Extensions Don't Match
+		/* argv */ {L"ProgramName", L"--longname", L"--longname_bc", L"--longname_b", L"--shor=t", L"-x"},
+		/* resp */ {'?', '?', 'b', '?', '?'},
+		/* args */ {},
+		/* left */ {},
+	},
 };
 
-INSTANTIATE_TEST_CASE_P(Getopt, GetoptTest, ::testing::ValuesIn(cases));
\ No newline at end of file
+INSTANTIATE_TEST_CASE_P(Getopt, GetoptTest, ::testing::Combine(::testing::Values(argvtype::wide, argvtype::narrow), ::testing::ValuesIn(cases)));
+
+// Lots of operands before the options mustn't make parsing take quadratic
+// time, and they must come out in order.
+TEST(GetoptLargeTest, MovesOptionsPastManyOperands) {
+	std::vector<std::wstring> operands;
+	for(int i = 0; i < 50000; ++i) {
+		operands.emplace_back(L"target" + std::to_wstring(i));
+	}
+
+	std::vector<wchar_t*> cmdline{const_cast<wchar_t*>(L"ProgramName")};
+	for(size_t i = 0; i < operands.size(); ++i) {
+		cmdline.push_back(operands[i].data());
+		if(i % 10 == 9) cmdline.push_back(const_cast<wchar_t*>(L"-s"));
+	}
+	cmdline.push_back(const_cast<wchar_t*>(L"-a"));
+	cmdline.push_back(const_cast<wchar_t*>(L"value"));
+
+	int shorts = 0;
+	int o = 0;
+	_optreset = true;
+	while((o = getopt_long(cmdline.size(), cmdline.data(), opts)) != -1) {
+		if(o == L's') ++shorts;
+		if(o == L'a') {
+			EXPECT_STREQ(L"value", optarg);
+		}
+	}
+
+	EXPECT_EQ(5000, shorts);
+	ASSERT_EQ(cmdline.size() - operands.size(), static_cast<size_t>(optind));
+	EXPECT_STREQ(L"value", cmdline[optind - 1]);
+	const std::vector<std::wstring> afterOptind(cmdline.begin() + optind, cmdline.end());
+	EXPECT_EQ(operands, afterOptind);
+}
+
+// Parsers that their callers own share nothing, so many command lines can be
+// parsed at once.
+TEST(GetoptConcurrencyTest, ParsesOnManyThreadsAtOnce) {
+	std::atomic<int> mismatches{0};
+	std::vector<std::thread> threads;
+	for(int t = 0; t < 8; ++t) {
+		threads.emplace_back([&mismatches]() {
+			for(int i = 0; i < 500; ++i) {
+				for(auto& testcase : cases) {
+					std::vector<wchar_t*> copiedCmdline{testcase.cmdline};
+					optparser parser{static_cast<int>(copiedCmdline.size()), copiedCmdline.data(), opts};
+					std::vector<int> responses;
+					std::vector<std::wstring> arguments;
+					optresult result;
+					while((result = parser.parse()).option != -1) {
+						responses.emplace_back(result.option);
+						if(result.arg) arguments.emplace_back(result.arg);
+					}
+					const std::vector<std::wstring> afterOptind(copiedCmdline.begin() + result.index, copiedCmdline.end());
+
+					if(responses != testcase.expectedResponses
+						|| arguments != testcase.expectedOptionArguments
+						|| afterOptind != testcase.expectedRemainingArguments) {
+						++mismatches;
+					}
+				}
+			}
+		});
+	}
+	for(auto& thread : threads) {
+		thread.join();
+	}
+	EXPECT_EQ(0, mismatches.load());
+}
+
+// Narrow argv is UTF-8, whose bytes past ASCII are negative as char.
+TEST(NarrowGetoptTest, PassesUtf8Through) {
+	std::string pack{"-s\xC3\xA9"};
+	std::string value{"--longname_a=caf\xC3\xA9"};
+	std::string operand{"\xC3\xA9t\xC3\xA9"};
+	std::vector<char*> cmdline{const_cast<char*>("ProgramName"), pack.data(), operand.data(), value.data()};
+
+	basic_optparser<char> parser{static_cast<int>(cmdline.size()), cmdline.data(), narrowOpts};
+	std::vector<int> responses;
+	basic_optresult<char> result;
+	while((result = parser.parse()).option != -1) {
+		responses.emplace_back(result.option);
+		if(result.option == 'a') {
+			EXPECT_STREQ("caf\xC3\xA9", result.arg);
+		}
+	}
+	EXPECT_EQ((std::vector<int>{'s', '?', '?', 'a'}), responses);
+	ASSERT_EQ(3, result.index);
+	EXPECT_EQ(operand.data(), cmdline[3]);
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Long options are found through optindex. Parsing 100,000 of them against
+// a table of 200 has to beat the scan that used to find them, which looked
+// for '=' and measured every name in the table for every argument.
+TEST(GetoptTimingTest, LooksUpLongOptionsWithoutScanning) {
+	constexpr int optionCount = 200;
+	constexpr int argCount = 100000;
+	std::vector<std::wstring> names;
+	for(int i = 0; i < optionCount; ++i) {
+		names.push_back(L"option-" + std::to_wstring(1000 + i));
+	}
+	std::vector<option> table;
+	for(int i = 0; i < optionCount; ++i) {
+		table.push_back({names[i].c_str(), 256 + i, i % 2 == 1});
+	}
+	table.push_back({nullptr, 0, false});
+
+	std::vector<std::wstring> args;
+	for(int i = 0; i < argCount; ++i) {
+		int o = (i * 7919) % optionCount;
+		args.push_back(L"--" + names[o] + (o % 2 ? L"=value" : L""));
+	}
+	std::vector<wchar_t*> cmdline{const_cast<wchar_t*>(L"ProgramName")};
+	for(auto& arg : args) {
+		cmdline.push_back(arg.data());
+	}
+
+	long long indexedSum = 0;
+	auto start = std::chrono::steady_clock::now();
+	optparser parser{static_cast<int>(cmdline.size()), cmdline.data(), table.data()};
+	optresult result;
+	while((result = parser.parse()).option != -1) {
+		indexedSum += result.option;
+	}
+	double indexed = millisecondsSince(start);
+
+	long long scannedSum = 0;
+	start = std::chrono::steady_clock::now();
+	for(auto& arg : args) {
+		const wchar_t* name = arg.c_str() + 2;
+		for(auto o = table.data(); o->name; ++o) {
+			const wchar_t* equals = wcschr(name, L'=');
+			size_t length = equals ? equals - name : wcslen(name);
+			if(wcslen(o->name) == length && wcsncmp(o->name, name, length) == 0) {
+				scannedSum += o->shopt;
+				break;
+			}
+		}
+	}
+	double scanned = millisecondsSince(start);
+
+	EXPECT_EQ(scannedSum, indexedSum);
+	printf("[   TIME   ] 100000 long options, optindex: %.1f ms\n", indexed);
+	printf("[   TIME   ] 100000 long options, scanning the table: %.1f ms\n", scanned);
+	EXPECT_LT(indexed, scanned);
+}
+
+// millisecondsToPermute returns how long parsing operandCount operands with
+// -s after every tenth takes, at best of three runs.
+static double millisecondsToPermute(int operandCount) {
+	std::vector<std::wstring> operands;
+	for(int i = 0; i < operandCount; ++i) {
+		operands.emplace_back(L"target" + std::to_wstring(i));
+	}
+
+	double best = 0;
+	for(int run = 0; run < 3; ++run) {
+		std::vector<wchar_t*> cmdline{const_cast<wchar_t*>(L"ProgramName")};
+		for(size_t i = 0; i < operands.size(); ++i) {
+			cmdline.push_back(operands[i].data());
+			if(i % 10 == 9) cmdline.push_back(const_cast<wchar_t*>(L"-s"));
+		}
+
+		int shorts = 0;
+		auto start = std::chrono::steady_clock::now();
+		optparser parser{static_cast<int>(cmdline.size()), cmdline.data(), opts};
+		optresult result;
+		while((result = parser.parse()).option != -1) {
+			if(result.option == L's') ++shorts;
+		}
+		double elapsed = millisecondsSince(start);
+
+		EXPECT_EQ(operandCount / 10, shorts);
+		if(run == 0 || elapsed < best) best = elapsed;
+	}
+	return best;
+}
+
+// Options are moved past the operands before them in one pass, so four
+// times the command line has to take about four times as long, not sixteen.
+// (Cache misses make it a little worse than four, so the bound is ten.)
+TEST(GetoptLargeTimingTest, PermutesInLinearTime) {
+	constexpr int operandCount = 200000;
+	double small = millisecondsToPermute(operandCount);
+	double large = millisecondsToPermute(operandCount * 4);
+
+	printf("[   TIME   ] %d interspersed operands: %.1f ms\n", operandCount, small);
+	printf("[   TIME   ] %d interspersed operands: %.1f ms\n", operandCount * 4, large);
+	EXPECT_LT(large, small * 10);
+}
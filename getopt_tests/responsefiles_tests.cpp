@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include <getopt/responsefiles.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+class ResponseFilesTest: public ::testing::Test {
+public:
+	void SetUp() {
+		auto info = ::testing::UnitTest::GetInstance()->current_test_info();
+		_dir = std::filesystem::temp_directory_path() / (std::string{"getopt_tests-"} + info->name());
+		std::filesystem::remove_all(_dir);
+		std::filesystem::create_directories(_dir);
+	}
+
+	void TearDown() {
+		std::filesystem::remove_all(_dir);
+	}
+
+protected:
+	std::filesystem::path _dir;
+
+	std::wstring file(const wchar_t* name, const std::string& contents) {
+		std::ofstream{_dir / name, std::ios::binary} << contents;
+		return (_dir / name).wstring();
+	}
+
+	std::vector<std::wstring> expand(std::vector<std::wstring> cmdline, int expectedError = 0) {
+		std::vector<wchar_t*> argv;
+		for(auto& arg : cmdline) argv.push_back(arg.data());
+		argv.push_back(nullptr);
+
+		int argc = static_cast<int>(cmdline.size());
+		wchar_t** expanded = argv.data();
+		EXPECT_EQ(expectedError, _files.expand(argc, expanded));
+		EXPECT_EQ(nullptr, expanded[argc]);
+		return {expanded, expanded + argc};
+	}
+
+	responsefiles _files;
+};
+
+TEST_F(ResponseFilesTest, LeavesCommandLinesWithoutThemAlone) {
+	std::vector<std::wstring> cmdline{L"ProgramName", L"-s", L"@", L"target"};
+	EXPECT_EQ(cmdline, expand(cmdline));
+}
+
+TEST_F(ResponseFilesTest, SplitsUtf8Files) {
+	auto path = file(L"args.txt", "\xEF\xBB\xBF-s  caf\xC3\xA9\r\n\"two words\" \"\"\ttail\xF0\x9F\x94\x97");
+	std::vector<std::wstring> expected{L"ProgramName", L"-f", L"-s", L"caf\u00E9", L"two words", L"", L"tail\U0001F517", L"last"};
+	EXPECT_EQ(expected, expand({L"ProgramName", L"-f", L"@" + path, L"last"}));
+}
+
+// The way CommandLineToArgvW reads them.
+TEST_F(ResponseFilesTest, UnescapesBackslashesOnlyBeforeQuotes) {
+	auto path = file(L"args.txt", R"(C:\dir\ "C:\a b\\" a\"b a\\\"b "x\\\\"y)");
+	std::vector<std::wstring> expected{L"ProgramName", L"C:\\dir\\", L"C:\\a b\\", L"a\"b", L"a\\\"b", L"x\\\\y"};
+	EXPECT_EQ(expected, expand({L"ProgramName", L"@" + path}));
+}
+
+TEST_F(ResponseFilesTest, SplitsUtf16Files) {
+	std::u16string text{u"\uFEFF--jobs 4 \"caf\u00E9 \U0001F517\"\n-v"};
+	std::string bytes;
+	for(char16_t c : text) {
+		bytes += static_cast<char>(c & 0xFF);
+		bytes += static_cast<char>(c >> 8);
+	}
+	auto path = file(L"args.txt", bytes);
+	auto empty = file(L"empty.txt", "");
+	std::vector<std::wstring> expected{L"ProgramName", L"--jobs", L"4", L"caf\u00E9 \U0001F517", L"-v"};
+	EXPECT_EQ(expected, expand({L"ProgramName", L"@" + empty, L"@" + path}));
+}
+
+TEST_F(ResponseFilesTest, StopsExpandingAfterDoubleDash) {
+	auto path = file(L"args.txt", "-s @nested");
+	std::vector<std::wstring> expected{L"ProgramName", L"-s", L"@nested", L"--", L"@" + path};
+	EXPECT_EQ(expected, expand({L"ProgramName", L"@" + path, L"--", L"@" + path}));
+}
+
+TEST_F(ResponseFilesTest, FailsOnMissingAndMalformedFiles) {
+	std::vector<std::wstring> cmdline{L"ProgramName", L"@" + (_dir / L"missing").wstring()};
+	EXPECT_EQ(cmdline, expand(cmdline, 2)); // ERROR_FILE_NOT_FOUND, ENOENT
+
+	auto path = file(L"args.txt", "caf\xE9");
+	std::wstring arg{L"@" + path};
+	std::vector<wchar_t*> argv{const_cast<wchar_t*>(L"ProgramName"), arg.data(), nullptr};
+	int argc = 2;
+	wchar_t** expanded = argv.data();
+	const wchar_t* failed = nullptr;
+	EXPECT_NE(0, _files.expand(argc, expanded, &failed));
+	EXPECT_EQ(path, failed);
+}